@@ -0,0 +1,436 @@
+/* gcc ex1.c -o ex1 -g -W -Wall -lpthread -std=gnu99 */
+
+/*
+ * Deterministic execution in the style of Calvin.
+ * The scheduler thread takes the transactions of the clients in epochs of
+ * BATCH_SIZE (round robin over the clients, so the order does not depend
+ * on timing), and requests the locks of each transaction in that order.
+ * A transaction whose locks are all granted goes to the ready queue, and a
+ * worker runs it and hands it back for its locks to be released.
+ * The whole read/write set is known before the transaction starts, so it
+ * never aborts and the final database is the same on every run.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "../trace/trace.h"
+#include "../phase/phase.h"
+
+#define DEBUG 0
+
+// 1: record the committed transactions to HISTORY_FILE for history/check
+//    (timestamp and write version: the position in the sequence + 1)
+#ifndef HISTORY
+#define HISTORY 0
+#endif
+#if HISTORY
+#include "../history/history.h"
+#endif
+
+#if DEBUG
+#define NUM_THREADS 4
+#define NUM_DATA 5
+#define TX_LEN 5
+#define N_REPEAT (12/NUM_THREADS)
+#else
+#define NUM_THREADS 4
+#define NUM_DATA 10
+//#define NUM_DATA 30
+#define TX_LEN 30
+//#define TX_LEN 10
+#define N_REPEAT (400000/NUM_THREADS)
+//#define N_REPEAT (4000/NUM_THREADS)
+#endif
+
+#define N_TXN (N_REPEAT*NUM_THREADS)
+#define BATCH_SIZE 1000                  // transactions per epoch
+#define MAX_INFLIGHT (2*BATCH_SIZE)      // transactions holding or waiting for locks
+#define QCAP 4096                        // > MAX_INFLIGHT
+
+typedef struct _DATA {
+    int val;
+#if HISTORY
+    int version;    // written under the exclusive lock
+#endif
+} DATA;
+
+typedef enum {NONE=0, READ=1, WRITE=2} TYPE;
+
+typedef struct _XACT {
+    int key;
+    TYPE type;
+} XACT;
+
+typedef struct _TXN {
+    XACT *xact;
+    TYPE type[NUM_DATA];
+    int n_wait;             // locks not granted yet (scheduler only)
+} TXN;
+
+typedef struct _LOCK_REQ {
+    int txn;
+    TYPE mode;              // READ: shared, WRITE: exclusive
+    bool granted;
+    bool done;
+} LOCK_REQ;
+
+// requests of one record in the deterministic order; granted ones first
+typedef struct _LOCK_QUEUE {
+    LOCK_REQ req[QCAP];
+    int head, tail;
+} LOCK_QUEUE;
+
+typedef struct _TXN_QUEUE {
+    int item[QCAP];
+    int head, tail;
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+} TXN_QUEUE;
+
+DATA Database[NUM_DATA];
+pthread_t threads[NUM_THREADS+1];
+XACT xact[TX_LEN*N_REPEAT][NUM_THREADS];
+XACT *client_xact[NUM_THREADS];
+TXN txns[N_TXN];
+LOCK_QUEUE LockTable[NUM_DATA];
+TXN_QUEUE ready_queue;      // scheduler -> workers
+TXN_QUEUE done_queue;       // workers -> scheduler
+int ready_buf[QCAP];        // granted in this round of the scheduler
+int n_ready;
+
+static struct timespec start_time;
+
+void init_time()
+{
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+int get_time()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - start_time.tv_sec)*1000000 + t.tv_nsec/1000;
+}
+
+void init_queue(TXN_QUEUE *q)
+{
+    q->head = q->tail = 0;
+    pthread_mutex_init(&q->mtx, NULL);
+    pthread_cond_init(&q->cond, NULL);
+}
+
+void push_queue(TXN_QUEUE *q, int id)
+{
+    pthread_mutex_lock(&q->mtx);
+    q->item[q->tail] = id;
+    q->tail = (q->tail+1) % QCAP;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->mtx);
+}
+
+void push_all_queue(TXN_QUEUE *q, int *buf, int n)
+{
+    if (n == 0) return;
+    pthread_mutex_lock(&q->mtx);
+    for (int i=0; i<n; i++) {
+        q->item[q->tail] = buf[i];
+        q->tail = (q->tail+1) % QCAP;
+        pthread_cond_signal(&q->cond);
+    }
+    pthread_mutex_unlock(&q->mtx);
+}
+
+int pop_queue(TXN_QUEUE *q)
+{
+    int id;
+    pthread_mutex_lock(&q->mtx);
+    while (q->head == q->tail) {
+        pthread_cond_wait(&q->cond, &q->mtx);
+    }
+    id = q->item[q->head];
+    q->head = (q->head+1) % QCAP;
+    pthread_mutex_unlock(&q->mtx);
+    return id;
+}
+
+// take every item; wait for one if wait is true
+int drain_queue(TXN_QUEUE *q, int *buf, bool wait)
+{
+    int n = 0;
+    pthread_mutex_lock(&q->mtx);
+    while (wait && q->head == q->tail) {
+        pthread_cond_wait(&q->cond, &q->mtx);
+    }
+    while (q->head != q->tail) {
+        buf[n++] = q->item[q->head];
+        q->head = (q->head+1) % QCAP;
+    }
+    pthread_mutex_unlock(&q->mtx);
+    return n;
+}
+
+// grant the requests at the head of k that are compatible with each other
+void grant(int k)
+{
+    LOCK_QUEUE *q = &LockTable[k];
+    for (int i=q->head; i!=q->tail; i=(i+1)%QCAP) {
+        LOCK_REQ *r = &q->req[i];
+        if (r->mode == WRITE && i != q->head) break;
+        if (!r->granted) {
+            r->granted = true;
+            if (--txns[r->txn].n_wait == 0) {
+                ready_buf[n_ready++] = r->txn;
+            }
+        }
+        if (r->mode == WRITE) break;
+    }
+}
+
+void request_locks(int id)
+{
+    TXN *x = &txns[id];
+    x->n_wait = 0;
+    for (int k=0; k<NUM_DATA; k++) {
+        if (x->type[k] != NONE) x->n_wait++;
+    }
+    for (int k=0; k<NUM_DATA; k++) {
+        if (x->type[k] != NONE) {
+            LOCK_QUEUE *q = &LockTable[k];
+            LOCK_REQ *r = &q->req[q->tail];
+            r->txn = id;
+            r->mode = (x->type[k] & WRITE) ? WRITE : READ;
+            r->granted = false;
+            r->done = false;
+            q->tail = (q->tail+1) % QCAP;
+            grant(k);
+        }
+    }
+}
+
+void release_locks(int id)
+{
+    TXN *x = &txns[id];
+    for (int k=0; k<NUM_DATA; k++) {
+        if (x->type[k] != NONE) {
+            LOCK_QUEUE *q = &LockTable[k];
+            for (int i=q->head; ; i=(i+1)%QCAP) {
+                if (q->req[i].txn == id) {
+                    q->req[i].done = true;
+                    break;
+                }
+            }
+            while (q->head != q->tail && q->req[q->head].done) {
+                q->head = (q->head+1) % QCAP;
+            }
+            grant(k);
+        }
+    }
+}
+
+// Sequencer: epoch e holds the next BATCH_SIZE transactions of the clients
+// in round robin order.
+void sequence_batch(int epoch)
+{
+    for (int i=epoch*BATCH_SIZE; i<(epoch+1)*BATCH_SIZE && i<N_TXN; i++) {
+        int client = i % NUM_THREADS;
+        int seq = i / NUM_THREADS;
+        TXN *x = &txns[i];
+        x->xact = client_xact[client] + seq*TX_LEN;
+        for (int k=0; k<NUM_DATA; k++) {
+            x->type[k] = NONE;
+        }
+        for (int j=0; j<TX_LEN; j++) {
+            x->type[x->xact[j].key] |= x->xact[j].type;
+        }
+    }
+}
+
+void *scheduler(void *arg)
+{
+    int done[QCAP];
+    int next = 0, n_done = 0, n_inflight = 0, n_epoch = 0;
+    int t_begin = get_time(), t_idle = 0, t;
+    (void)arg;
+
+    while (n_done < N_TXN) {
+        bool idle = (next == N_TXN || n_inflight == MAX_INFLIGHT);
+        if (idle) t = get_time();
+        int n = drain_queue(&done_queue, done, idle);
+        if (idle) t_idle += get_time() - t;
+        for (int i=0; i<n; i++) {
+            release_locks(done[i]);
+        }
+        n_done += n;
+        n_inflight -= n;
+        while (next < N_TXN && n_inflight < MAX_INFLIGHT) {
+            if (next % BATCH_SIZE == 0) {
+                sequence_batch(n_epoch++);
+            }
+            request_locks(next++);
+            n_inflight++;
+        }
+        // hand the transactions granted in this round over at once
+        push_all_queue(&ready_queue, ready_buf, n_ready);
+        n_ready = 0;
+    }
+    for (int i=0; i<NUM_THREADS; i++) {
+        push_queue(&ready_queue, -1);
+    }
+    printf("scheduler: time: elap=%f idle=%f n_epoch=%d\n",
+           (get_time()-t_begin)*1e-6,t_idle*1e-6,n_epoch);
+    return NULL;
+}
+
+void *worker(void *arg)
+{
+    int  val[NUM_DATA];
+    int thread_id = (int)(long)arg;
+    uint64_t t, tsum = 0;
+    int t_begin = get_time(), t_end;
+    double t_elap, t_wait;
+    int n_commit=0;
+#if HISTORY
+    HIST_BUF hist;
+    hist_init(&hist, thread_id);
+#endif
+
+    for (;;) {
+        t = phase_now();
+        int id = pop_queue(&ready_queue);
+        tsum += phase_now() - t;
+        if (id < 0) break;
+        TXN *x = &txns[id];
+
+        for (int k=0; k<NUM_DATA; k++) {
+            val[k] = (x->type[k] & READ) ? Database[k].val : 0;
+        }
+
+        // modify
+        for (int i=0; i<TX_LEN; i++) {
+            if (x->xact[i].type == READ) {
+                val[x->xact[i].key] += 1;
+            }
+        }
+
+#if DEBUG
+        printf("%d:",id);
+        for (int i=0; i<TX_LEN; i++) {
+            printf(" %c%d",(x->xact[i].type==READ) ? 'r':'w', x->xact[i].key);
+        }
+        printf("\n");
+#endif
+
+        for (int k=0; k<NUM_DATA; k++) {
+            if (x->type[k] & WRITE) {
+                Database[k].val = val[k];
+            }
+        }
+#if HISTORY
+        // the locks are granted in the sequence order
+        hist_begin(&hist, id+1);
+        for (int k=0; k<NUM_DATA; k++) {
+            if (x->type[k] & READ) hist_read(&hist, k, Database[k].version);
+            if (x->type[k] & WRITE) hist_write(&hist, k, Database[k].version = id+1);
+        }
+        hist_commit(&hist);
+#endif
+
+        push_queue(&done_queue, id);
+        n_commit += 1;
+    }
+    t_end = get_time();
+#if HISTORY
+    hist_finish(&hist);
+#endif
+    t_elap = (t_end-t_begin)*1e-6;
+    t_wait = tsum/phase_tsc_hz();
+    printf("%d: time: elap=%f wait=%f wait_ratio=%f n_abort=0 n_commit=%d\n",
+           thread_id,t_elap,t_wait,t_wait/t_elap,n_commit);
+
+    return NULL;
+}
+
+
+int main(int argc, char *argv[]){
+    int i, j, sum;
+
+    // Initialize Database
+    for (i=0; i<NUM_DATA; i++) {
+        Database[i].val = 0;
+#if HISTORY
+        Database[i].version = 0;
+#endif
+        LockTable[i].head = LockTable[i].tail = 0;
+    }
+    init_queue(&ready_queue);
+    init_queue(&done_queue);
+
+    // Create Transaction
+    sum = 0;
+    if (argc > 1) {
+        // replay the trace argv[1] instead of generating the transactions
+        const TRACE_HEADER *h = trace_open(argv[1], NUM_THREADS, TX_LEN, N_REPEAT, NUM_DATA);
+        for (i=0; i<NUM_THREADS; i++) {
+            client_xact[i] = TRACE_XACT(h, i);
+        }
+        sum = trace_n_read(h, NUM_THREADS, N_REPEAT);
+    } else {
+        for(i=0; i<NUM_THREADS; i++){
+#if DEBUG
+            printf("thread%d:",i);
+#endif
+            for(j=0; j<TX_LEN*N_REPEAT; j++){
+                xact[j][i].type = (random()&1) ? READ : WRITE;
+                xact[j][i].key = (int)(random()/(1.0+RAND_MAX) * NUM_DATA);
+#if DEBUG
+                printf(" %c%d",(xact[j][i].type==READ) ? 'r':'w', xact[j][i].key);
+#endif
+                if (xact[j][i].type==READ) {
+                    sum += 1;
+                }
+            }
+#if DEBUG
+            printf("\n");
+#endif
+        }
+        for(i=0; i<NUM_THREADS; i++){
+            client_xact[i] = xact[i];
+        }
+    }
+    printf("# of READ=%d\n",sum);
+#if HISTORY
+    hist_open();
+#endif
+    init_time();
+
+    // Start threads
+    pthread_create(&threads[NUM_THREADS], NULL, scheduler, NULL);
+    for(i=0; i<NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, worker, (void*)(long)i);
+    }
+
+    // Join threads
+    for(i=0; i<=NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+#if HISTORY
+    hist_close();
+    printf("history: %s\n", HISTORY_FILE);
+#endif
+
+    // Print result
+    sum = 0;
+    for (i=0; i<NUM_DATA; i++) {
+        printf("%d ",Database[i].val);
+        sum += Database[i].val;
+    }
+    printf("\nsum=%d\n",sum);
+
+    return 0;
+}
@@ -0,0 +1,239 @@
+// Abort causes and hot keys, shared by the engines (C and C++).
+//
+// A worker records each abort with its cause, the key it conflicted on and,
+// where the engine knows it, the other transaction:
+//   conflict_add(&conflicts, CF_VALIDATE, k, Database[k].tid);
+// The counts are kept per thread in a small open-addressing table of
+// (key, cause), so recording takes no lock; CONFLICT_SLOTS bounds its size
+// and aborts on more distinct pairs are counted as lost.
+// conflict_report() prints the thread's causes and merges its table,
+// conflict_report_total() prints the causes of all threads and the
+// CONFLICT_TOP keys with the most aborts.  A caller with its own total
+// (procedure/) uses conflict_merge() and conflict_print_top() instead.
+//
+// The other transaction is the engine's id for it: the tid (Silo, hybrid),
+// wts (TicToc), transaction number (OCC) or timestamp (MVTO, MVOCC) that
+// made the abort necessary; -1 if unknown.
+
+#ifndef CONFLICT_H
+#define CONFLICT_H
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef CONFLICT_TOP
+#define CONFLICT_TOP 10
+#endif
+#define CONFLICT_SLOTS 4096     // power of 2
+#define CONFLICT_NO_KEY UINT64_MAX  // key -1: the engine can't tell which
+
+enum {
+    CF_VALIDATE = 0,    // a read version changed before the commit
+    CF_LOCKED,          // a record was locked by another transaction
+    CF_LATE_WRITE,      // a write older than a read of a later transaction (MVTO)
+    CF_WRITESET,        // the write set of a committed transaction intersects the read set (OCC)
+    CF_SNAPSHOT,        // a version committed after the snapshot (first-committer-wins)
+    N_CAUSE
+};
+static const char *const cause_name[N_CAUSE] =
+    {"read_validate", "locked", "late_write", "writeset", "snapshot"};
+
+typedef struct _CONFLICT_SLOT {
+    uint64_t key;       // 64 bits for the sparse keys of procedure/
+    int cause;
+    long n;             // 0: empty
+    long with;          // the other transaction of the last abort
+} CONFLICT_SLOT;
+
+typedef struct _CONFLICTS {
+    long n[N_CAUSE];
+    long n_lost;        // aborts not in slot[] (table full)
+    CONFLICT_SLOT last; // the last abort
+    CONFLICT_SLOT *slot;
+} CONFLICTS;
+
+static inline void conflict_init(CONFLICTS *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->last.key = CONFLICT_NO_KEY;
+    c->slot = (CONFLICT_SLOT*)calloc(CONFLICT_SLOTS, sizeof(CONFLICT_SLOT));
+}
+
+// false if the table is full
+static inline int conflict_slot_add(CONFLICTS *c, int cause, uint64_t key, long with, long n)
+{
+    uint64_t h = (key * N_CAUSE + cause) * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 32;
+    for (int i=0; i<CONFLICT_SLOTS; i++) {
+        CONFLICT_SLOT *s = &c->slot[(h + i) & (CONFLICT_SLOTS-1)];
+        if (s->n == 0) {
+            s->key = key;
+            s->cause = cause;
+        }
+        if (s->key == key && s->cause == cause) {
+            s->n += n;
+            s->with = with;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// one abort on key (-1 if the engine can't tell which)
+static inline void conflict_add(CONFLICTS *c, int cause, uint64_t key, long with)
+{
+    c->n[cause]++;
+    if (!conflict_slot_add(c, cause, key, with, 1)) c->n_lost++;
+    c->last.key = key;
+    c->last.cause = cause;
+    c->last.with = with;
+}
+
+static inline void conflict_print_causes(const CONFLICTS *c)
+{
+    long total = 0;
+    for (int i=0; i<N_CAUSE; i++) {
+        total += c->n[i];
+    }
+    printf("n_abort=%ld", total);
+    for (int i=0; i<N_CAUSE; i++) {
+        if (c->n[i] > 0) printf(" %s=%ld", cause_name[i], c->n[i]);
+    }
+    if (c->n_lost > 0) printf(" (%ld not per key)", c->n_lost);
+    printf("\n");
+}
+
+// "last abort: <cause> key <k> with <id>" for a transaction retrying for long
+static inline void conflict_print_last(const CONFLICTS *c)
+{
+    long total = 0;
+    for (int i=0; i<N_CAUSE; i++) {
+        total += c->n[i];
+    }
+    if (total == 0) {
+        printf("last abort: none");
+        return;
+    }
+    if (c->last.key == CONFLICT_NO_KEY) {
+        printf("last abort: %s key ? with %ld", cause_name[c->last.cause], c->last.with);
+    } else {
+        printf("last abort: %s key %" PRIu64 " with %ld",
+               cause_name[c->last.cause], c->last.key, c->last.with);
+    }
+}
+
+// add the aborts of c to sum and free c's table
+static inline void conflict_merge(CONFLICTS *sum, CONFLICTS *c)
+{
+    for (int i=0; i<N_CAUSE; i++) {
+        sum->n[i] += c->n[i];
+    }
+    for (int i=0; i<CONFLICT_SLOTS; i++) {
+        CONFLICT_SLOT *s = &c->slot[i];
+        if (s->n > 0 && !conflict_slot_add(sum, s->cause, s->key, s->with, s->n)) {
+            sum->n_lost += s->n;
+        }
+    }
+    sum->n_lost += c->n_lost;
+    free(c->slot);
+    c->slot = NULL;
+}
+
+static CONFLICTS conflict_sum;
+static pthread_mutex_t conflict_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// at the end of the worker: print the thread's aborts by cause and merge them
+static inline void conflict_report(CONFLICTS *c, int thread)
+{
+    pthread_mutex_lock(&conflict_lock);
+    if (conflict_sum.slot == NULL) conflict_init(&conflict_sum);
+    printf("%d: aborts: ", thread);
+    conflict_print_causes(c);
+    conflict_merge(&conflict_sum, c);
+    pthread_mutex_unlock(&conflict_lock);
+}
+
+typedef struct _CONFLICT_KEY {
+    uint64_t key;
+    long n;
+    long n_cause[N_CAUSE];
+    long with;
+} CONFLICT_KEY;
+
+static int conflict_cmp_key(const void *a, const void *b)
+{
+    const CONFLICT_KEY *x = (const CONFLICT_KEY*)a, *y = (const CONFLICT_KEY*)b;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+static int conflict_cmp_n(const void *a, const void *b)
+{
+    const CONFLICT_KEY *x = (const CONFLICT_KEY*)a, *y = (const CONFLICT_KEY*)b;
+    if (x->n != y->n) return (x->n < y->n) ? 1 : -1;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+// aborts of c by cause, and the keys with the most aborts with a bar
+// relative to the hottest one; each line starts with who
+static inline void conflict_print_top(const CONFLICTS *c, const char *who)
+{
+    printf("%saborts: ", who);
+    conflict_print_causes(c);
+
+    // (key, cause) -> key
+    CONFLICT_KEY *k = (CONFLICT_KEY*)calloc(CONFLICT_SLOTS, sizeof(CONFLICT_KEY));
+    int n = 0;
+    long total = 0;
+    for (int i=0; i<CONFLICT_SLOTS; i++) {
+        const CONFLICT_SLOT *s = &c->slot[i];
+        if (s->n == 0) continue;
+        k[n].key = s->key;
+        k[n].n = s->n;
+        k[n].n_cause[s->cause] = s->n;
+        k[n].with = s->with;
+        total += s->n;
+        n++;
+    }
+    qsort(k, n, sizeof(CONFLICT_KEY), conflict_cmp_key);
+    int m = 0;
+    for (int i=0; i<n; i++) {
+        if (m > 0 && k[m-1].key == k[i].key) {
+            k[m-1].n += k[i].n;
+            for (int j=0; j<N_CAUSE; j++) {
+                k[m-1].n_cause[j] += k[i].n_cause[j];
+            }
+        } else {
+            k[m++] = k[i];
+        }
+    }
+    qsort(k, m, sizeof(CONFLICT_KEY), conflict_cmp_n);
+    for (int i=0; i<m && i<CONFLICT_TOP; i++) {
+        char bar[21];
+        int w = (int)(20.0 * k[i].n / k[0].n + 0.5);
+        memset(bar, '#', w);
+        bar[w] = '\0';
+        if (k[i].key == CONFLICT_NO_KEY) {
+            printf("%shot key    ?: ", who);
+        } else {
+            printf("%shot key %4" PRIu64 ": ", who, k[i].key);
+        }
+        printf("%-20s %ld (%.1f%%)", bar, k[i].n, 100.0 * k[i].n / total);
+        for (int j=0; j<N_CAUSE; j++) {
+            if (k[i].n_cause[j] > 0) printf(" %s=%ld", cause_name[j], k[i].n_cause[j]);
+        }
+        printf(" last_with=%ld\n", k[i].with);
+    }
+    free(k);
+}
+
+// in main after the workers: the aborts of all threads
+static inline void conflict_report_total(void)
+{
+    if (conflict_sum.slot != NULL) conflict_print_top(&conflict_sum, "");
+}
+
+#endif // CONFLICT_H
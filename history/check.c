@@ -0,0 +1,265 @@
+/* gcc check.c -o check -g -O2 -W -Wall -std=gnu99 */
+
+// Serializability checker for the histories written with HISTORY=1.
+//   ./check [-t] history.bin
+//
+// Every committed transaction is a node.  For each key with the versions
+// v0 < v1 < ... written by T0, T1, ... (version 0: the initial value):
+//   ww: Ti -> Ti+1
+//   wr: Ti -> every reader of vi
+//   rw: every reader of vi -> Ti+1 (anti-dependency)
+// The history is conflict serializable iff this graph has no cycle; the
+// shortest cycle through the first transaction found on a cycle is printed.
+//
+// -t: also check the MVTO rules of mvto/mvto.rb with the timestamps of
+// the transactions: a transaction writes the version of its timestamp,
+// and reads the largest version not newer than its timestamp.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "history.h"
+
+typedef struct _ACCESS {
+    int64_t key;
+    int64_t version;
+    int32_t txn;        // node
+} ACCESS;
+
+typedef struct _EDGE {
+    int32_t from;
+    int32_t to;
+} EDGE;
+
+static int cmp_access(const void *a, const void *b)
+{
+    const ACCESS *x = a, *y = b;
+    if (x->key != y->key) return (x->key < y->key) ? -1 : 1;
+    if (x->version != y->version) return (x->version < y->version) ? -1 : 1;
+    return (x->txn > y->txn) - (x->txn < y->txn);
+}
+
+static int cmp_edge(const void *a, const void *b)
+{
+    const EDGE *x = a, *y = b;
+    if (x->from != y->from) return (x->from < y->from) ? -1 : 1;
+    return (x->to > y->to) - (x->to < y->to);
+}
+
+// index of the first write of (key, version) or later in w[0..n)
+static long lower_bound(const ACCESS *w, long n, int64_t key, int64_t version)
+{
+    long lo = 0, hi = n;
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (w[mid].key < key || (w[mid].key == key && w[mid].version < version)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// node as "T<node>(thread txn ts)"
+static void print_txn(int32_t node, const long *offset, const int64_t *ts)
+{
+    int t = 0;
+    while (offset[t+1] <= node) t++;
+    printf(" T%d(thread %d txn %ld ts %" PRId64 ")", node, t, node - offset[t], ts[node]);
+}
+
+// print the shortest cycle through s (breadth first search back to s)
+static void print_cycle(int32_t s, long n_txn, const EDGE *e, const long *adj,
+                        const long *offset, const int64_t *ts)
+{
+    int32_t *parent = malloc(sizeof(int32_t) * n_txn);
+    int32_t *queue = malloc(sizeof(int32_t) * n_txn);
+    for (long i=0; i<n_txn; i++) parent[i] = -1;
+    long head = 0, tail = 0;
+    int32_t last = -1;
+    queue[tail++] = s;
+    while (head < tail && last < 0) {
+        int32_t u = queue[head++];
+        for (long i=adj[u]; i<adj[u+1]; i++) {
+            int32_t v = e[i].to;
+            if (v == s) {
+                last = u;
+                break;
+            }
+            if (parent[v] < 0) {
+                parent[v] = u;
+                queue[tail++] = v;
+            }
+        }
+    }
+    // s -> ... -> last -> s, collected backwards
+    long n = 0;
+    for (int32_t u = last; u != s; u = parent[u]) queue[n++] = u;
+    queue[n++] = s;
+    printf("cycle of %ld transactions:", n);
+    for (long i=n-1; i>=0 && i>=n-20; i--) {
+        print_txn(queue[i], offset, ts);
+    }
+    printf("%s\n", n > 20 ? " ..." : "");
+    free(parent);
+    free(queue);
+}
+
+int main(int argc, char *argv[])
+{
+    bool check_ts = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "t")) != -1) {
+        if (opt == 't') check_ts = true;
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-t] history.bin\n", argv[0]);
+        return 1;
+    }
+    FILE *f = fopen(argv[optind], "rb");
+    if (f == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long n_ops = ftell(f) / sizeof(HIST_OP);
+    fseek(f, 0, SEEK_SET);
+    HIST_OP *ops = malloc(sizeof(HIST_OP) * (n_ops + 1));
+    if (fread(ops, sizeof(HIST_OP), n_ops, f) != (size_t)n_ops) {
+        perror(argv[optind]);
+        return 1;
+    }
+    fclose(f);
+
+    // node of (thread, txn): offset[thread] + txn
+    int n_threads = 0;
+    for (long i=0; i<n_ops; i++) {
+        if (ops[i].thread >= n_threads) n_threads = ops[i].thread + 1;
+    }
+    long *offset = calloc(n_threads + 1, sizeof(long));
+    for (long i=0; i<n_ops; i++) {
+        if (ops[i].txn + 1 > offset[ops[i].thread + 1]) offset[ops[i].thread + 1] = ops[i].txn + 1;
+    }
+    for (int t=0; t<n_threads; t++) {
+        offset[t+1] += offset[t];
+    }
+    long n_txn = offset[n_threads];
+    int64_t *ts = calloc(n_txn, sizeof(int64_t));
+    ACCESS *w = malloc(sizeof(ACCESS) * (n_ops + 1));
+    ACCESS *r = malloc(sizeof(ACCESS) * (n_ops + 1));
+    long n_w = 0, n_r = 0;
+    for (long i=0; i<n_ops; i++) {
+        int32_t node = offset[ops[i].thread] + ops[i].txn;
+        ACCESS a = {ops[i].key, ops[i].version, node};
+        if (ops[i].type == HIST_BEGIN) ts[node] = ops[i].version;
+        if (ops[i].type == HIST_WRITE) w[n_w++] = a;
+        if (ops[i].type == HIST_READ) r[n_r++] = a;
+    }
+    free(ops);
+    qsort(w, n_w, sizeof(ACCESS), cmp_access);
+    printf("threads=%d transactions=%ld reads=%ld writes=%ld\n", n_threads, n_txn, n_r, n_w);
+
+    long n_error = 0;
+    for (long i=1; i<n_w; i++) {
+        if (w[i].key == w[i-1].key && w[i].version == w[i-1].version && n_error++ < 10) {
+            printf("error: key %" PRId64 " version %" PRId64 " written by T%d and T%d\n",
+                   w[i].key, w[i].version, w[i-1].txn, w[i].txn);
+        }
+    }
+
+    // at most 2 edges per read and 1 per write
+    EDGE *e = malloc(sizeof(EDGE) * (2*n_r + n_w + 1));
+    long n_e = 0;
+    for (long i=1; i<n_w; i++) {
+        if (w[i].key == w[i-1].key && w[i].txn != w[i-1].txn) {
+            e[n_e++] = (EDGE){w[i-1].txn, w[i].txn};                      // ww
+        }
+    }
+    for (long i=0; i<n_r; i++) {
+        long j = lower_bound(w, n_w, r[i].key, r[i].version);
+        bool found = (j < n_w && w[j].key == r[i].key && w[j].version == r[i].version);
+        if (!found && r[i].version != 0) {
+            if (n_error++ < 10) {
+                printf("error: T%d read key %" PRId64 " version %" PRId64 ", which no committed transaction wrote\n",
+                       r[i].txn, r[i].key, r[i].version);
+            }
+            continue;
+        }
+        if (found && w[j].txn != r[i].txn) {
+            e[n_e++] = (EDGE){w[j].txn, r[i].txn};                         // wr
+        }
+        long k = found ? j+1 : j;   // the next version
+        if (k < n_w && w[k].key == r[i].key && w[k].txn != r[i].txn) {
+            e[n_e++] = (EDGE){r[i].txn, w[k].txn};                         // rw
+        }
+        if (check_ts) {
+            // the largest version <= ts of the reader, not its own write
+            // unless it read that
+            long m = lower_bound(w, n_w, r[i].key, ts[r[i].txn] + 1) - 1;
+            if (m >= 0 && w[m].txn == r[i].txn && r[i].version != w[m].version) m--;
+            int64_t expect = (m >= 0 && w[m].key == r[i].key) ? w[m].version : 0;
+            if (r[i].version != expect && n_error++ < 10) {
+                printf("error: T%d (ts=%" PRId64 ") read key %" PRId64 " version %" PRId64 ", expected %" PRId64 "\n",
+                       r[i].txn, ts[r[i].txn], r[i].key, r[i].version, expect);
+            }
+        }
+    }
+    if (check_ts) {
+        for (long i=0; i<n_w; i++) {
+            if (w[i].version != ts[w[i].txn] && n_error++ < 10) {
+                printf("error: T%d (ts=%" PRId64 ") wrote key %" PRId64 " version %" PRId64 "\n",
+                       w[i].txn, ts[w[i].txn], w[i].key, w[i].version);
+            }
+        }
+    }
+
+    // adjacency lists
+    qsort(e, n_e, sizeof(EDGE), cmp_edge);
+    long *adj = calloc(n_txn + 1, sizeof(long));
+    for (long i=0; i<n_e; i++) {
+        adj[e[i].from + 1]++;
+    }
+    for (long i=0; i<n_txn; i++) {
+        adj[i+1] += adj[i];
+    }
+    printf("edges=%ld\n", n_e);
+
+    // iterative DFS; color 0: new, 1: on the stack, 2: done
+    char *color = calloc(n_txn, 1);
+    int32_t *stack = malloc(sizeof(int32_t) * (n_txn + 1));
+    long *next = malloc(sizeof(long) * (n_txn + 1));
+    bool cycle = false;
+    for (long s=0; s<n_txn && !cycle; s++) {
+        if (color[s] != 0) continue;
+        long sp = 0;
+        stack[0] = s;
+        next[0] = adj[s];
+        color[s] = 1;
+        while (sp >= 0 && !cycle) {
+            int32_t u = stack[sp];
+            if (next[sp] == adj[u+1]) {
+                color[u] = 2;
+                sp--;
+                continue;
+            }
+            int32_t v = e[next[sp]++].to;
+            if (color[v] == 1) {
+                print_cycle(v, n_txn, e, adj, offset, ts);
+                cycle = true;
+            } else if (color[v] == 0) {
+                color[v] = 1;
+                sp++;
+                stack[sp] = v;
+                next[sp] = adj[v];
+            }
+        }
+    }
+    if (n_error > 0) printf("%ld errors\n", n_error);
+    printf("%s\n", (cycle || n_error > 0) ? "NOT SERIALIZABLE" : "serializable");
+    return (cycle || n_error > 0) ? 1 : 0;
+}
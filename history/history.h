@@ -0,0 +1,113 @@
+// History capture for the serializability checker (C and C++).
+//
+// Each worker appends the operations of its committed transactions to its
+// own buffer, so recording takes no lock and no atomic.  A full buffer is
+// appended to the history file under a mutex, HISTORY_CHUNK ops at a time.
+// Only committed transactions are recorded: an engine calls hist_begin(),
+// hist_read() and hist_write() after its validation succeeded (or with the
+// versions it kept for that), then hist_commit().
+//
+// A version is a number per key that identifies the transaction that wrote
+// it, larger for a later write of the same key; 0 is the initial value.
+// (Silo: tid, MVTO: timestamp, 2PL: a write counter under the X lock.)
+// Keys and versions are 64-bit, for the 64-bit keys of procedure/ and the
+// rdtsc timestamps of mvocc.
+//
+// history/check builds the dependency graph from the file and looks for a
+// cycle.
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef HISTORY_FILE
+#define HISTORY_FILE "history.bin"
+#endif
+#define HISTORY_CHUNK 65536
+
+enum {HIST_BEGIN=0, HIST_READ=1, HIST_WRITE=2};
+
+typedef struct _HIST_OP {
+    uint32_t txn;       // commit number in the thread
+    uint16_t thread;
+    uint8_t  type;      // HIST_BEGIN: version is the timestamp of the transaction
+    uint8_t  pad;
+    int64_t  key;
+    int64_t  version;
+} HIST_OP;
+
+typedef struct _HIST_BUF {
+    HIST_OP *ops;
+    int n;
+    int thread;
+    uint32_t txn;
+} HIST_BUF;
+
+static FILE *hist_file;
+static pthread_mutex_t hist_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void hist_open_file(const char *path)
+{
+    hist_file = fopen(path, "wb");
+    if (hist_file == NULL) {
+        perror(path);
+        exit(1);
+    }
+}
+
+static inline void hist_open(void)
+{
+    hist_open_file(HISTORY_FILE);
+}
+
+static inline void hist_close(void)
+{
+    fclose(hist_file);
+}
+
+static inline void hist_init(HIST_BUF *b, int thread)
+{
+    b->ops = (HIST_OP*)malloc(sizeof(HIST_OP) * HISTORY_CHUNK);
+    b->n = 0;
+    b->thread = thread;
+    b->txn = 0;
+}
+
+static inline void hist_flush(HIST_BUF *b)
+{
+    pthread_mutex_lock(&hist_lock);
+    fwrite(b->ops, sizeof(HIST_OP), b->n, hist_file);
+    pthread_mutex_unlock(&hist_lock);
+    b->n = 0;
+}
+
+static inline void hist_add(HIST_BUF *b, int type, int64_t key, int64_t version)
+{
+    HIST_OP *op = &b->ops[b->n];
+    op->txn = b->txn;
+    op->thread = (uint16_t)b->thread;
+    op->type = (uint8_t)type;
+    op->pad = 0;
+    op->key = key;
+    op->version = version;
+    if (++b->n == HISTORY_CHUNK) hist_flush(b);
+}
+
+// ts: timestamp of the transaction (0 if the engine has none)
+static inline void hist_begin(HIST_BUF *b, int64_t ts)   {hist_add(b, HIST_BEGIN, 0, ts);}
+static inline void hist_read(HIST_BUF *b, int64_t key, int64_t version)  {hist_add(b, HIST_READ, key, version);}
+static inline void hist_write(HIST_BUF *b, int64_t key, int64_t version) {hist_add(b, HIST_WRITE, key, version);}
+static inline void hist_commit(HIST_BUF *b)          {b->txn++;}
+
+// at the end of the worker
+static inline void hist_finish(HIST_BUF *b)
+{
+    hist_flush(b);
+    free(b->ops);
+}
+
+#endif // HISTORY_H
@@ -0,0 +1,327 @@
+/* gcc ex1.c -o ex1 -g -W -Wall -lpthread -std=gnu99 */
+
+/*
+ * Partitioned execution in the style of H-Store.
+ * Database is split into NUM_THREADS partitions (key % NUM_THREADS) and
+ * worker p owns partition p.  A single-partition transaction runs on its
+ * owner with no per-record locks and no validation; the only
+ * synchronization is the partition lock, which is uncontended unless a
+ * multi-partition transaction is running.  A multi-partition transaction
+ * takes the locks of all the partitions it touches in partition order, so
+ * it runs alone on them and never aborts.
+ *
+ * MP_PERCENT is the percentage of multi-partition transactions: they pick
+ * keys from all of Database, the others only from the worker's partition.
+ * silo/ex2.c and twopl/ex1.c take the same knob to generate the same
+ * workload.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "../trace/trace.h"
+#include "../phase/phase.h"
+
+#define DEBUG 0
+
+#ifndef MP_PERCENT
+#define MP_PERCENT 10
+#endif
+
+// 1: record the committed transactions to HISTORY_FILE for history/check
+//    (version: a write counter of the record, under the partition lock)
+#ifndef HISTORY
+#define HISTORY 0
+#endif
+#if HISTORY
+#include "../history/history.h"
+#endif
+
+#if DEBUG
+#define NUM_THREADS 4
+#define NUM_DATA 8
+#define TX_LEN 5
+#define N_REPEAT (12/NUM_THREADS)
+#else
+#define NUM_THREADS 4
+#define NUM_DATA 10
+//#define NUM_DATA 30
+#define TX_LEN 30
+//#define TX_LEN 10
+#define N_REPEAT (400000/NUM_THREADS)
+//#define N_REPEAT (4000/NUM_THREADS)
+#endif
+
+#define PARTITION(k) ((k) % NUM_THREADS)
+
+typedef struct _DATA {
+    int val;
+#if HISTORY
+    int version;
+#endif
+} DATA;
+
+typedef struct _PARTITION {
+    bool lock;
+} __attribute__((aligned(64))) PARTITION_T;
+
+typedef enum {NONE=0, READ=1, WRITE=2} TYPE;
+
+typedef struct _XACT {
+    int key;
+    TYPE type;
+} XACT;
+
+typedef struct _THREAD_ARGS {
+    int   id;
+    XACT *xact;
+} THREAD_ARGS;
+
+DATA Database[NUM_DATA];
+PARTITION_T Partition[NUM_THREADS];
+pthread_t threads[NUM_THREADS];
+XACT xact[NUM_THREADS][TX_LEN*N_REPEAT];
+
+static struct timespec start_time;
+
+void init_time()
+{
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+int get_time()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - start_time.tv_sec)*1000000 + t.tv_nsec/1000;
+}
+
+#define LOCK(p)                                 \
+    {                                           \
+        t = phase_now();                        \
+        my_lock(&Partition[p].lock);            \
+        tsum += phase_now() - t;                \
+}
+
+#define UNLOCK(p)                               \
+    {                                           \
+        my_unlock(&Partition[p].lock);          \
+    }
+
+inline static void my_lock(bool *ptr) {
+    for (;;) {
+        bool expected=false;
+        bool desired=true;
+        if (*ptr == expected) {
+            if (__atomic_compare_exchange_n(ptr, &expected, desired, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return;
+            }
+        }
+        usleep(1);
+    }
+}
+
+inline static void my_unlock(bool *ptr) {
+    __atomic_store_n(ptr, false, __ATOMIC_RELEASE);
+}
+
+// a random key of partition p
+int partition_key(int p)
+{
+    int n = (NUM_DATA - p + NUM_THREADS - 1) / NUM_THREADS;
+    return p + NUM_THREADS * (int)(random()/(1.0+RAND_MAX) * n);
+}
+
+void *worker(void *arg)
+{
+    TYPE type[NUM_DATA];
+    bool part[NUM_THREADS];
+    int  val[NUM_DATA];
+    XACT *xact = ((THREAD_ARGS*)arg)->xact;
+    int thread_id = ((THREAD_ARGS*)arg)->id;
+    uint64_t t, tsum = 0;
+    int t_begin = get_time(), t_end;
+    double t_elap, t_lock;
+    int n_single=0;
+    int n_multi=0;
+#if HISTORY
+    HIST_BUF hist;
+    hist_init(&hist, thread_id);
+#endif
+
+    for (int repeat=0; repeat < N_REPEAT; repeat++) {
+        int n_part = 0;
+
+        for (int k=0; k<NUM_DATA; k++) {
+            type[k] = NONE;
+            val[k] = 0;
+        }
+        for (int p=0; p<NUM_THREADS; p++) {
+            part[p] = false;
+        }
+
+        // get Read/Write set and the partitions it touches; trace padding
+        // (NONE on key 0) touches no partition
+        for (int i=0; i<TX_LEN; i++) {
+            if (xact[i].type == NONE) continue;
+            type[xact[i].key] |= xact[i].type;
+            if (!part[PARTITION(xact[i].key)]) {
+                part[PARTITION(xact[i].key)] = true;
+                n_part++;
+            }
+        }
+
+        // single-partition: our own partition only
+        // multi-partition: every partition touched, in partition order
+        for (int p=0; p<NUM_THREADS; p++) {
+            if (part[p]) {
+                LOCK(p);
+            }
+        }
+        if (n_part == 0 || (n_part == 1 && part[thread_id])) {
+            n_single++;
+        } else {
+            n_multi++;
+        }
+
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] & READ) {
+                val[k] = Database[k].val;
+            }
+        }
+
+        // modify
+        for (int i=0; i<TX_LEN; i++) {
+            if (xact[i].type == READ) {
+                val[xact[i].key] += 1;
+            }
+        }
+
+#if DEBUG
+        for (int i=0; i<TX_LEN; i++) {
+            printf(" %c%d",(xact[i].type==READ) ? 'r':'w', xact[i].key);
+        }
+        printf(" (%s)\n",(n_part == 1) ? "single" : "multi");
+#endif
+
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] & WRITE) {
+                Database[k].val = val[k];
+            }
+        }
+#if HISTORY
+        hist_begin(&hist, 0);
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] & READ) hist_read(&hist, k, Database[k].version);
+            if (type[k] & WRITE) hist_write(&hist, k, ++Database[k].version);
+        }
+        hist_commit(&hist);
+#endif
+        for (int p=0; p<NUM_THREADS; p++) {
+            if (part[p]) {
+                UNLOCK(p);
+            }
+        }
+
+        xact += TX_LEN;
+    }
+    t_end = get_time();
+#if HISTORY
+    hist_finish(&hist);
+#endif
+    t_elap = (t_end-t_begin)*1e-6;
+    t_lock = tsum/phase_tsc_hz();
+    printf("%d: time: elap=%f lock=%f lock_ratio=%f n_abort=0 n_single=%d n_multi=%d\n",
+           thread_id,t_elap,t_lock,t_lock/t_elap,n_single,n_multi);
+
+    return NULL;
+}
+
+
+int main(int argc, char *argv[]){
+    int i, j, sum;
+    THREAD_ARGS thread_args[NUM_THREADS];
+
+    // Initialize Database
+    for (i=0; i<NUM_DATA; i++) {
+        Database[i].val = 0;
+#if HISTORY
+        Database[i].version = 0;
+#endif
+    }
+    for (i=0; i<NUM_THREADS; i++) {
+        Partition[i].lock = false;
+    }
+
+    // Create Transaction
+    sum = 0;
+    if (argc > 1) {
+        // replay the trace argv[1] instead of generating the transactions
+        const TRACE_HEADER *h = trace_open(argv[1], NUM_THREADS, TX_LEN, N_REPEAT, NUM_DATA);
+        for (i=0; i<NUM_THREADS; i++) {
+            thread_args[i].xact = TRACE_XACT(h, i);
+            thread_args[i].id = i;
+        }
+        sum = trace_n_read(h, NUM_THREADS, N_REPEAT);
+    } else {
+        for(i=0; i<NUM_THREADS; i++){
+#if DEBUG
+            printf("thread%d:",i);
+#endif
+            for(j=0; j<TX_LEN*N_REPEAT; j+=TX_LEN){
+                bool multi = (random()%100 < MP_PERCENT);
+                for (int k=j; k<j+TX_LEN; k++) {
+                    xact[i][k].type = (random()&1) ? READ : WRITE;
+                    xact[i][k].key = multi ? (int)(random()/(1.0+RAND_MAX) * NUM_DATA)
+                                           : partition_key(i);
+#if DEBUG
+                    printf(" %c%d",(xact[i][k].type==READ) ? 'r':'w', xact[i][k].key);
+#endif
+                    if (xact[i][k].type==READ) {
+                        sum += 1;
+                    }
+                }
+            }
+            thread_args[i].xact = xact[i];
+            thread_args[i].id = i;
+#if DEBUG
+            printf("\n");
+#endif
+        }
+    }
+    printf("# of READ=%d\n",sum);
+#if HISTORY
+    hist_open();
+#endif
+    init_time();
+
+    // Start threads
+    for(i=0; i<NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, worker, &thread_args[i]);
+    }
+
+    // Join threads
+    for(i=0; i<NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+#if HISTORY
+    hist_close();
+    printf("history: %s\n", HISTORY_FILE);
+#endif
+
+    // Print result
+    sum = 0;
+    for (i=0; i<NUM_DATA; i++) {
+        printf("%d ",Database[i].val);
+        sum += Database[i].val;
+    }
+    printf("\nsum=%d\n",sum);
+
+    return 0;
+}
@@ -0,0 +1,439 @@
+/* gcc ex1.c -o ex1 -g -W -Wall -lpthread -std=gnu99 */
+
+/*
+ * Hybrid concurrency control on the silo/ex2.c record layout.
+ * Every record is either in OCC mode (read without a lock, tid validated
+ * at commit as in Silo) or in LOCK mode (locked when it is accessed and
+ * held until commit as in 2PL).  Both kinds of access can be mixed in one
+ * transaction and on one record, because an OCC reader aborts if the
+ * record is locked by someone else or its tid changed.
+ *
+ * Each record counts its conflicts (OCC validation failures, contended
+ * lock waits).  An OCC record moves to LOCK mode when it has LOCK_CONFLICTS
+ * or more in STAT_WINDOW accesses; a LOCK record goes back to OCC mode when
+ * it has fewer than OCC_CONFLICTS in LOCK_WINDOWS*STAT_WINDOW accesses, so
+ * a hot record does not flip back after one quiet window.
+ *
+ * Locks are taken in key order while the transaction holds nothing with a
+ * larger key, so blocking waits cannot form a cycle; any other lock is a
+ * try-lock and the transaction aborts when it fails.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "../trace/trace.h"
+#include "../phase/phase.h"
+#include "../conflict/conflict.h"
+
+#define DEBUG 0
+
+// 1: record the committed transactions to HISTORY_FILE for history/check
+//    (read version: the tid seen, write version: the commit tid)
+#ifndef HISTORY
+#define HISTORY 0
+#endif
+#if HISTORY
+#include "../history/history.h"
+#endif
+
+// concurrency control of the records
+//  0: OCC for all records (Silo)
+//  1: LOCK for all records (2PL with exclusive locks)
+//  2: per-record adaptive
+#ifndef CC_MODE
+#define CC_MODE 2
+#endif
+
+#define STAT_WINDOW 1024
+#define LOCK_CONFLICTS 2
+#define OCC_CONFLICTS 1
+#define LOCK_WINDOWS 4     // LOCK records decide every LOCK_WINDOWS windows
+
+#if DEBUG
+#define NUM_THREADS 4
+#define NUM_DATA 8
+#define HOT_DATA 2
+#define HOT_PERCENT 50
+#define TX_LEN 5
+#define N_REPEAT (12/NUM_THREADS)
+#else
+#define NUM_THREADS 4
+#define NUM_DATA 100
+#define HOT_DATA 4       // keys [0,HOT_DATA) are hot
+#define HOT_PERCENT 50   // percentage of the accesses to the hot keys
+#define TX_LEN 10
+#define N_REPEAT (400000/NUM_THREADS)
+#endif
+
+typedef enum {OCC=0, LOCKING=1} MODE;
+
+typedef struct _DATA {
+    int val;
+    int tid;
+    bool lock;
+    int mode;        // MODE
+    int n_access;    // accesses in the current window
+    int n_conflict;  // conflicts in the current window
+    int n_switch;
+} DATA;
+
+typedef enum {NONE=0, READ=1, WRITE=2} TYPE;
+
+typedef struct _XACT {
+    int key;
+    TYPE type;
+} XACT;
+
+typedef struct _THREAD_ARGS {
+    int   id;
+    XACT *xact;
+} THREAD_ARGS;
+
+DATA Database[NUM_DATA];
+pthread_t threads[NUM_THREADS];
+XACT xact[TX_LEN*N_REPEAT][NUM_THREADS];
+
+static struct timespec start_time;
+
+void init_time()
+{
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+int get_time()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - start_time.tv_sec)*1000000 + t.tv_nsec/1000;
+}
+
+#define LOCK(k)                                 \
+    {                                           \
+        t = phase_now();                        \
+        my_lock(&Database[k].lock);             \
+        tsum += phase_now() - t;                \
+}
+
+#define UNLOCK(k)                               \
+    {                                           \
+        my_unlock(&Database[k].lock);           \
+    }
+
+inline static void my_lock(bool *ptr) {
+    for (;;) {
+        bool expected=false;
+        bool desired=true;
+        if (*ptr == expected) {
+            if (__atomic_compare_exchange_n(ptr, &expected, desired, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return;
+            }
+        }
+        usleep(1);
+    }
+}
+
+inline static bool my_trylock(bool *ptr) {
+    bool expected=false;
+    return __atomic_compare_exchange_n(ptr, &expected, true, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+inline static void my_unlock(bool *ptr) {
+    __atomic_store_n(ptr, false, __ATOMIC_RELEASE);
+}
+
+inline static void add_conflict(int k) {
+    __atomic_fetch_add(&Database[k].n_conflict, 1, __ATOMIC_RELAXED);
+}
+
+// count an access to k and decide the mode at the end of each window
+inline static MODE access_mode(int k) {
+#if CC_MODE == 2
+    DATA *d = &Database[k];
+    int n = __atomic_add_fetch(&d->n_access, 1, __ATOMIC_RELAXED);
+    int m = __atomic_load_n(&d->mode, __ATOMIC_RELAXED);
+    if (n % (STAT_WINDOW * (m == LOCKING ? LOCK_WINDOWS : 1)) == 0) {
+        int c = __atomic_exchange_n(&d->n_conflict, 0, __ATOMIC_RELAXED);
+        if ((m == OCC && c >= LOCK_CONFLICTS) ||
+            (m == LOCKING && c < OCC_CONFLICTS)) {
+            __atomic_store_n(&d->mode, !m, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&d->n_switch, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return (MODE)__atomic_load_n(&d->mode, __ATOMIC_RELAXED);
+#else
+    (void)k;
+    return (MODE)CC_MODE;
+#endif
+}
+
+void *worker(void *arg)
+{
+    TYPE type[NUM_DATA];
+    MODE mode[NUM_DATA];
+    bool held[NUM_DATA];
+    int  val[NUM_DATA];
+    int  tid[NUM_DATA];
+    XACT *xact = ((THREAD_ARGS*)arg)->xact;
+    int thread_id = ((THREAD_ARGS*)arg)->id;
+    uint64_t t, tsum = 0;
+    int t_begin = get_time(), t_end;
+    double t_elap, t_lock;
+    int n_abort=0;
+    int n_commit=0;
+    long n_lock_access=0;
+    long n_occ_access=0;
+    int commit_tid;
+    int max_held;
+    int conflict, cause;
+    CONFLICTS conflicts;
+    conflict_init(&conflicts);
+#if HISTORY
+    HIST_BUF hist;
+    hist_init(&hist, thread_id);
+#endif
+
+    for (int repeat=0; repeat < N_REPEAT; repeat++) {
+
+        for (int k=0; k<NUM_DATA; k++) {
+            type[k] = NONE;
+            val[k] = 0;
+            tid[k] = 0;
+        }
+
+        // get Read/Write set
+        for (int i=0; i<TX_LEN; i++) {
+            type[xact[i].key] |= xact[i].type;
+        }
+
+    retry:
+        max_held = -1;
+        conflict = -1;
+        for (int k=0; k<NUM_DATA; k++) {
+            held[k] = false;
+        }
+
+        // read data; LOCK records are locked in key order
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] == NONE) continue;
+            mode[k] = access_mode(k);
+            if (mode[k] == LOCKING) {
+                n_lock_access++;
+                if (!my_trylock(&Database[k].lock)) {
+                    add_conflict(k);
+                    LOCK(k);
+                }
+                held[k] = true;
+                max_held = k;
+            } else {
+                n_occ_access++;
+            }
+            if (type[k] & READ) {
+                tid[k] = __atomic_load_n(&Database[k].tid, __ATOMIC_ACQUIRE);
+                val[k] = Database[k].val;
+            }
+        }
+
+        // modify
+        for (int i=0; i<TX_LEN; i++) {
+            if (xact[i].type == READ) {
+                val[xact[i].key] += 1;
+            }
+        }
+
+        // Phase 1 (lock the rest of the write set)
+        for (int k=0; k<NUM_DATA; k++) {
+            if ((type[k] & WRITE) && !held[k]) {
+                if (k > max_held) {
+                    LOCK(k);
+                } else if (!my_trylock(&Database[k].lock)) {
+                    conflict = k;
+                    cause = CF_LOCKED;
+                    goto abort;
+                }
+                held[k] = true;
+                if (k > max_held) max_held = k;
+            }
+        }
+
+        // Phase 2 (validate the OCC reads)
+        for (int k=0; k<NUM_DATA; k++) {
+            if ((type[k] & READ) && mode[k] == OCC) {
+                if (tid[k] != __atomic_load_n(&Database[k].tid, __ATOMIC_ACQUIRE)) {
+                    conflict = k;
+                    cause = CF_VALIDATE;
+                    goto abort;
+                }
+                if (!held[k] && __atomic_load_n(&Database[k].lock, __ATOMIC_ACQUIRE)) {
+                    conflict = k;
+                    cause = CF_LOCKED;
+                    goto abort;
+                }
+            }
+        }
+
+        // commit tid
+        commit_tid = 0;
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] != NONE) {
+                int t = Database[k].tid;
+                if (t > commit_tid) commit_tid = t;
+            }
+        }
+        commit_tid++;
+
+#if HISTORY
+        // the OCC reads are validated, the LOCK reads and the write set are locked
+        hist_begin(&hist, 0);
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] & READ) hist_read(&hist, k, tid[k]);
+            if (type[k] & WRITE) hist_write(&hist, k, commit_tid);
+        }
+        hist_commit(&hist);
+#endif
+
+#if DEBUG
+        for (int i=0; i<TX_LEN; i++) {
+            printf(" %c%d",(xact[i].type==READ) ? 'r':'w', xact[i].key);
+        }
+        printf("\n");
+#endif
+
+        // Phase 3 (write and unlock)
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] & WRITE) {
+                Database[k].val = val[k];
+                __atomic_store_n(&Database[k].tid, commit_tid, __ATOMIC_RELEASE);
+            }
+            if (held[k]) {
+                UNLOCK(k);
+            }
+        }
+
+        n_commit += 1;
+        xact += TX_LEN;
+        continue;
+
+    abort:
+        add_conflict(conflict);
+        conflict_add(&conflicts, cause, conflict, Database[conflict].tid);
+        for (int k=0; k<NUM_DATA; k++) {
+            if (held[k]) {
+                UNLOCK(k);
+            }
+        }
+        n_abort += 1;
+        usleep(3);
+        goto retry;
+    }
+    t_end = get_time();
+#if HISTORY
+    hist_finish(&hist);
+#endif
+    t_elap = (t_end-t_begin)*1e-6;
+    t_lock = tsum/phase_tsc_hz();
+    printf("%d: time: elap=%f lock=%f lock_ratio=%f n_abort=%d n_commit=%d lock_access=%ld occ_access=%ld\n",
+           thread_id,t_elap,t_lock,t_lock/t_elap,n_abort,n_commit,n_lock_access,n_occ_access);
+    conflict_report(&conflicts, thread_id);
+
+    return NULL;
+}
+
+
+int main(int argc, char *argv[]){
+    int i, j, sum;
+    int n_hot_lock=0, n_cold_lock=0, n_switch=0;
+    THREAD_ARGS thread_args[NUM_THREADS];
+
+    // Initialize Database
+    for (i=0; i<NUM_DATA; i++) {
+        Database[i].val = 0;
+        Database[i].tid = 0;
+        Database[i].lock = false;
+        Database[i].mode = (CC_MODE == 1) ? LOCKING : OCC;
+        Database[i].n_access = 0;
+        Database[i].n_conflict = 0;
+        Database[i].n_switch = 0;
+    }
+
+    // Create Transaction
+    sum = 0;
+    if (argc > 1) {
+        // replay the trace argv[1] instead of generating the transactions
+        const TRACE_HEADER *h = trace_open(argv[1], NUM_THREADS, TX_LEN, N_REPEAT, NUM_DATA);
+        for (i=0; i<NUM_THREADS; i++) {
+            thread_args[i].xact = TRACE_XACT(h, i);
+            thread_args[i].id = i;
+        }
+        sum = trace_n_read(h, NUM_THREADS, N_REPEAT);
+    } else {
+        for(i=0; i<NUM_THREADS; i++){
+#if DEBUG
+            printf("thread%d:",i);
+#endif
+            for(j=0; j<TX_LEN*N_REPEAT; j++){
+                xact[j][i].type = (random()&1) ? READ : WRITE;
+                if (random()%100 < HOT_PERCENT) {
+                    xact[j][i].key = (int)(random()/(1.0+RAND_MAX) * HOT_DATA);
+                } else {
+                    xact[j][i].key = HOT_DATA +
+                        (int)(random()/(1.0+RAND_MAX) * (NUM_DATA-HOT_DATA));
+                }
+#if DEBUG
+                printf(" %c%d",(xact[j][i].type==READ) ? 'r':'w', xact[j][i].key);
+#endif
+                if (xact[j][i].type==READ) {
+                    sum += 1;
+                }
+                thread_args[i].xact = xact[i];
+                thread_args[i].id = i;
+            }
+#if DEBUG
+            printf("\n");
+#endif
+        }
+    }
+    printf("# of READ=%d\n",sum);
+#if HISTORY
+    hist_open();
+#endif
+    init_time();
+
+    // Start threads
+    for(i=0; i<NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, worker, &thread_args[i]);
+    }
+
+    // Join threads
+    for(i=0; i<NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    conflict_report_total();
+#if HISTORY
+    hist_close();
+    printf("history: %s\n", HISTORY_FILE);
+#endif
+
+    // Print result
+    sum = 0;
+    for (i=0; i<NUM_DATA; i++) {
+        printf("%d%s ",Database[i].val,(Database[i].mode == LOCKING) ? "L" : "");
+        sum += Database[i].val;
+        if (Database[i].mode == LOCKING) {
+            if (i < HOT_DATA) n_hot_lock++; else n_cold_lock++;
+        }
+        n_switch += Database[i].n_switch;
+    }
+    printf("\nmode: hot_lock=%d/%d cold_lock=%d/%d switch=%d\n",
+           n_hot_lock,HOT_DATA,n_cold_lock,NUM_DATA-HOT_DATA,n_switch);
+    printf("sum=%d\n",sum);
+
+    return 0;
+}
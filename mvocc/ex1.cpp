@@ -0,0 +1,788 @@
+/* g++ ex1.cpp -o ex1 -g -O3 -std=c++17 -W -Wall -lpthread  */
+
+// Multi-version OCC in the style of Cicada.
+// The version chains, slab pools, epochs and dirty-queue GC are the ones of
+// mvto/ex1.cpp.  The differences are:
+//  - timestamps come from a per-thread clock (rdtsc, thread id in the low
+//    bits), so there is no shared counter;
+//  - writes are buffered and only installed (as pending versions) at commit,
+//    after which the read set is validated: rts of the read versions is
+//    raised and every read must still be the visible version at ts;
+//  - read-only transactions read at the oldest active timestamp, which is
+//    final, so they are neither validated nor aborted;
+//  - each item has one inlined version slot next to the chain head, used by
+//    the newest version when it is free.
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <x86intrin.h>
+#include "../trace/trace.h"
+#include "../conflict/conflict.h"
+
+#define DEBUG 0
+
+// percentage of WRITE operations in the workload (mvto uses 50)
+#ifndef WRITE_PERCENT
+#define WRITE_PERCENT 50
+#endif
+
+// 1: the newest version is placed in the item's inlined slot when it is free
+#ifndef INLINE_VERSION
+#define INLINE_VERSION 1
+#endif
+
+// 1: committed transactions を HISTORY_FILE に記録する (history/check 用)。
+//    read は読んだバージョン、write は自分の timestamp を version とする。
+//    read-only は snapshot より前のバージョンを読むので snapshot-1 を
+//    timestamp とする。自分の write set からの read は記録しない。
+#ifndef HISTORY
+#define HISTORY 0
+#endif
+#if HISTORY
+#include "../history/history.h"
+#endif
+
+#if DEBUG
+#define N_TRANSACTION 1200
+#define NUM_THREADS 4
+#define NUM_DATA 10
+#define TX_LEN 5
+#define DPRINTF(...) std::printf(__VA_ARGS__)
+#else
+#define N_TRANSACTION 280000
+#ifndef NUM_THREADS
+#define NUM_THREADS 28
+#endif
+#define NUM_DATA 50
+#define TX_LEN 10
+#define DPRINTF(...) {}
+#endif
+#define N_REPEAT (N_TRANSACTION/NUM_THREADS)
+
+// low bits of a timestamp hold the thread id
+#define TS_THREAD_BITS 8
+static_assert(NUM_THREADS <= (1<<TS_THREAD_BITS), "too many threads");
+
+typedef int Value;
+typedef long Timestamp;
+
+typedef enum {NONE=0, READ=1, WRITE=2} TYPE;
+
+typedef struct _XACT {
+    int key;
+    TYPE type;
+} XACT;
+
+typedef enum {COMMITTED=0, PENDING=1, ABORTED=2} STATUS;
+
+typedef struct _VersionValue {
+    Timestamp version;                 // wts
+    Value value;
+    std::atomic<struct _VersionValue*> next;
+    std::atomic<Timestamp> rts;        // max timestamp of the transactions that read this version
+    std::atomic<int> status;
+    bool inlined;                      // the inlined slot of a DataItem
+    std::atomic<bool> in_use;          // inlined slot only
+} VersionValue;
+
+static void init_version(VersionValue *x, Timestamp version, Value value, VersionValue *next)
+{
+    x->version = version;
+    x->value = value;
+    x->next.store(next);
+    x->rts.store(0);
+    x->status.store(COMMITTED);
+}
+
+typedef struct _GcStats {
+    int n_sweep;     // gc passes
+    long n_item;     // DataItem::gc() calls
+    double t_total;  // time spent in gc passes
+    double t_max;    // longest gc pass
+} GcStats;
+
+typedef struct _ThreadResult {
+    double t_elap;
+    int n_abort;
+    int n_commit;
+    int n_read_only;  // committed without validation
+    long n_version;   // versions installed
+    long n_inlined;   // ... of which in the inlined slot
+    GcStats gc;
+} ThreadResult;
+
+
+class Timer {
+    struct timespec start_time;
+public:
+    Timer() {clock_gettime(CLOCK_MONOTONIC, &start_time);}
+
+    double get_time()
+    {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec - start_time.tv_sec + (t.tv_nsec - start_time.tv_nsec)/1e9;
+    }
+};
+
+
+// Per-thread slab allocator for version chain nodes (see mvto/ex1.cpp).
+template <typename T>
+class SlabPool {
+    static const int SLAB_NODES = 4096;
+    struct FreeNode {
+        FreeNode *next;
+    };
+    static_assert(sizeof(T) >= sizeof(FreeNode), "node too small");
+    char *slab_ptr = NULL;
+    char *slab_end = NULL;
+    FreeNode *free_list = NULL;
+public:
+    T *alloc() {
+        if (free_list != NULL) {
+            FreeNode *p = free_list;
+            free_list = p->next;
+            return (T*)p;
+        }
+        if (slab_ptr == slab_end) {
+            slab_ptr = (char*)malloc(sizeof(T)*SLAB_NODES);
+            slab_end = slab_ptr + sizeof(T)*SLAB_NODES;
+        }
+        T *p = (T*)slab_ptr;
+        slab_ptr += sizeof(T);
+        return p;
+    }
+
+    void free(T *p) {
+        FreeNode *f = (FreeNode*)p;
+        f->next = free_list;
+        free_list = f;
+    }
+};
+
+
+// Epoch-based reclamation (see mvto/ex1.cpp).
+// A retired inlined version is not returned to the pool; its slot is
+// released so that the item can use it again.
+class EpochManager {
+    struct alignas(64) LocalEpoch {
+        std::atomic<unsigned long> epoch{0};  // 0: quiescent
+    };
+    struct Limbo {
+        unsigned long epoch = 0;
+        std::vector<VersionValue*> versions;
+    };
+    struct alignas(64) ThreadState {
+        SlabPool<VersionValue> version_pool;
+        Limbo limbo[3];
+        int n_exit = 0;
+    };
+    alignas(64) std::atomic<unsigned long> global_epoch{1};
+    LocalEpoch local[NUM_THREADS];
+    ThreadState state[NUM_THREADS];
+    static thread_local int thread_id;
+
+    void try_advance() {
+        unsigned long e = global_epoch.load();
+        for (int i=0; i<NUM_THREADS; i++) {
+            unsigned long l = local[i].epoch.load();
+            if (l != 0 && l != e) return;
+        }
+        global_epoch.compare_exchange_strong(e, e+1);
+    }
+
+    void reclaim(ThreadState &st) {
+        unsigned long e = global_epoch.load();
+        for (auto &lb : st.limbo) {
+            // nodes retired in epoch e0 are unreachable once global_epoch >= e0+2
+            if (lb.epoch + 2 > e) continue;
+            for (auto x : lb.versions) {
+                for (VersionValue *y; (y = x->next.load()) != NULL; x = y) {
+                    if (x->inlined) {
+                        x->in_use.store(false);
+                    } else {
+                        st.version_pool.free(x);
+                    }
+                }
+            }
+            lb.versions.clear();
+        }
+    }
+
+    Limbo &current_limbo(ThreadState &st) {
+        unsigned long e = global_epoch.load();
+        Limbo &lb = st.limbo[e % 3];
+        if (lb.epoch != e) {
+            reclaim(st);
+            lb.epoch = e;
+        }
+        return lb;
+    }
+
+public:
+    void register_thread(int id) {
+        thread_id = id;
+    }
+
+    void enter() {
+        local[thread_id].epoch.store(global_epoch.load());
+        reclaim(state[thread_id]);
+    }
+
+    void exit() {
+        local[thread_id].epoch.store(0);
+        if (++state[thread_id].n_exit % 64 == 0) {
+            try_advance();
+        }
+    }
+
+    // the pool's nodes come from malloc; only a DataItem's own slot is inlined
+    VersionValue *alloc_version() {
+        VersionValue *x = state[thread_id].version_pool.alloc();
+        x->inlined = false;
+        return x;
+    }
+
+    void free_version(VersionValue *x) {
+        state[thread_id].version_pool.free(x);
+    }
+
+    // x: first node of a chain cut off by gc(), terminated by the sentinel
+    void retire_versions(VersionValue *x) {
+        current_limbo(state[thread_id]).versions.push_back(x);
+        try_advance();
+    }
+};
+
+thread_local int EpochManager::thread_id = 0;
+
+EpochManager epoch;
+
+
+// A version is visible to the transaction ts if it is the newest committed
+// version with version < ts.
+class DataItem {
+    VersionValue list_begin;
+    VersionValue inline_ver;
+    VersionValue list_end;
+
+    // timestamp より前の最新バージョン (pending, aborted を含む)
+    VersionValue *find(Timestamp timestamp) {
+        VersionValue *x = list_begin.next.load();
+        while (x->version >= timestamp) {
+            x = x->next.load();
+        }
+        return x;
+    }
+
+    // pending のバージョンは commit/abort が決まるまで待ち、abort されたものは飛ばす
+    static VersionValue *committed(VersionValue *x) {
+        for (;; x = x->next.load()) {
+            int st;
+            while ((st = x->status.load()) == PENDING) {
+                std::this_thread::yield();
+            }
+            if (st == COMMITTED) return x;
+        }
+    }
+
+    VersionValue *alloc_version(bool *inlined) {
+#if INLINE_VERSION
+        if (!inline_ver.in_use.load() && !inline_ver.in_use.exchange(true)) {
+            *inlined = true;
+            return &inline_ver;
+        }
+#endif
+        *inlined = false;
+        return epoch.alloc_version();
+    }
+
+public:
+    DataItem() {
+        init_version(&list_end,0,0,NULL);
+        init_version(&list_begin,0,0,&list_end);
+        init_version(&inline_ver,0,0,NULL);
+        list_end.inlined = list_begin.inlined = false;
+        inline_ver.inlined = true;
+        inline_ver.in_use.store(false);
+    }
+
+    VersionValue *read(Timestamp timestamp) {
+        return committed(find(timestamp));
+    }
+
+    // validation: x must still be the visible version at timestamp.
+    // A pending version in between is a conflict, so it is not waited for.
+    // Its version is returned in *with.
+    bool is_visible(Timestamp timestamp, VersionValue *x, Timestamp *with = NULL) {
+        VersionValue *y = find(timestamp);
+        while (y->status.load() == ABORTED) {
+            y = y->next.load();
+        }
+        if (with != NULL) *with = y->version;
+        return y == x;
+    }
+
+    // 書き込みを pending で加える。直前のバージョンが timestamp より後の
+    // トランザクションに読まれていたら NULL (abort)。その rts を *with に返す。
+    VersionValue *install(Timestamp timestamp, Value value, bool *inlined, Timestamp *with = NULL) {
+        VersionValue *m = NULL;
+        for (auto itr = &list_begin;; ) {
+            retry:
+            VersionValue *x = itr->next.load();
+            if (x->version < timestamp) {
+                if (committed(x)->rts.load() > timestamp) {
+                    DPRINTF("(abort %ld<%ld<%ld)\n", x->version, timestamp, x->rts.load());
+                    if (with != NULL) *with = committed(x)->rts.load();
+                    if (m != NULL) {
+                        free_version(m, *inlined);
+                    }
+                    return NULL;
+                }
+                if (m == NULL) {
+                    m = alloc_version(inlined);
+                    init_version(m,timestamp,value,x);
+                    m->status.store(PENDING);
+                }
+                m->next.store(x);
+                if (!itr->next.compare_exchange_weak(x,m)) {
+                    goto retry;
+                }
+                return m;
+            }
+            itr = x;
+        }
+    }
+
+    void free_version(VersionValue *m, bool inlined) {
+        if (inlined) {
+            m->in_use.store(false);
+        } else {
+            epoch.free_version(m);
+        }
+    }
+
+    // m の直前の committed バージョンが timestamp より後に読まれていないか
+    // (読まれていたらその rts を *with に返す)
+    static bool check_pred(Timestamp timestamp, VersionValue *m, Timestamp *with = NULL) {
+        Timestamp rts = committed(m->next.load())->rts.load();
+        if (with != NULL) *with = rts;
+        return rts <= timestamp;
+    }
+
+    static void update_rts(Timestamp timestamp, VersionValue *x) {
+        Timestamp rts = x->rts.load();
+        while (rts < timestamp && !x->rts.compare_exchange_weak(rts,timestamp)) {}
+    }
+
+    // 戻り値: 残したバージョンより新しいバージョンがある (後の GC で消せる) なら true
+    bool gc(Timestamp timestamp) {
+        // timestamp 以降のトランザクションが読む最新の committed バージョンを残し、
+        // それより古いものを切り離して epoch に渡す。
+        VersionValue *keep = find(timestamp);
+        while (keep->status.load() != COMMITTED) {
+            keep = keep->next.load();
+        }
+        if (keep->next.load() == NULL) { // list_end
+            return list_begin.next.load() != keep;
+        }
+        VersionValue *x = keep->next.load();
+        if (x->next.load() != NULL) {
+            if (!keep->next.compare_exchange_strong(x,&list_end)) return true;
+            epoch.retire_versions(x);
+        }
+        return list_begin.next.load() != keep;
+    }
+
+    void print() {
+        printf("ver:val:rts{");
+        for (auto x = list_begin.next.load(); x != NULL; x = x->next.load()) {
+            printf("%ld:%d:%ld%s,",x->version,x->value,x->rts.load(),
+                   x->inlined ? "(i)" : "");
+        }
+        printf("}\n");
+    }
+};
+
+
+// Per-thread clocks.  A timestamp is (rdtsc << TS_THREAD_BITS | thread id);
+// the clock of a thread never goes backwards, so no shared counter is needed.
+// The slots publish the timestamp of the running transaction, and a lower
+// bound is published before taking a new one, so min_active_timestamp()
+// never passes a transaction that is about to start.
+// Read-only transactions publish their snapshot in a separate field, so a
+// new snapshot follows the writers and is not held back by older readers.
+class TimeStampGenerator {
+    struct alignas(64) ActiveSlot {
+        std::atomic<Timestamp> ts{0};        // 0: no active read-write transaction
+        std::atomic<Timestamp> snapshot{0};  // 0: no active read-only transaction
+        Timestamp clock = 0;
+    };
+    ActiveSlot active[NUM_THREADS];
+
+    static Timestamp now() {
+        return (Timestamp)__rdtsc() << TS_THREAD_BITS;
+    }
+
+    Timestamp min_writer_timestamp() {
+        Timestamp ts = now();
+        for (int i=0; i<NUM_THREADS; i++) {
+            Timestamp t = active[i].ts.load();
+            if (t != 0 && t < ts) ts = t;
+        }
+        return ts;
+    }
+public:
+    Timestamp get_timestamp(int thread_id) {
+        ActiveSlot &a = active[thread_id];
+        a.ts.store(now());
+        Timestamp c = __rdtsc();
+        a.clock = (c > a.clock) ? c : a.clock+1;
+        Timestamp ts = a.clock << TS_THREAD_BITS | thread_id;
+        a.ts.store(ts);
+        return ts;
+    }
+
+    // 読み込み専用トランザクションの timestamp。これより前の書き込みは全て
+    // 終わっているので、読んだ値が後から変わることはない。
+    // 求めてから公開するまでの間に GC が watermark をこれより上に進めないよう、
+    // 先に下限を公開してから求め直す。後から求めた値は下限以上で、公開した
+    // 下限を見なかった GC の watermark 以上でもある (その後に始まる書き込みの
+    // timestamp はその GC の now() より大きい)。
+    Timestamp get_snapshot(int thread_id) {
+        ActiveSlot &a = active[thread_id];
+        a.snapshot.store(min_writer_timestamp());
+        Timestamp ts = min_writer_timestamp();
+        a.snapshot.store(ts);
+        return ts;
+    }
+
+    Timestamp min_active_timestamp() {
+        Timestamp ts = min_writer_timestamp();
+        for (int i=0; i<NUM_THREADS; i++) {
+            Timestamp t = active[i].snapshot.load();
+            if (t != 0 && t < ts) ts = t;
+        }
+        return ts;
+    }
+
+    void transaction_end(int thread_id) {
+        active[thread_id].ts.store(0);
+        active[thread_id].snapshot.store(0);
+    }
+};
+
+
+// Incremental GC with the dirty queue of mvto/ex1.cpp; workers collect
+// GC_BATCH items every GC_INTERVAL commits.
+class GarbageCollector {
+    DataItem *database;
+    TimeStampGenerator *tsg;
+    std::atomic<bool> dirty[NUM_DATA];
+    std::mutex mtx;
+    std::deque<int> queue;
+    alignas(64) std::atomic<Timestamp> gc_ts{0};  // watermark of the last collect()
+
+    // 前回から watermark が GC_ADVANCE より進んでいれば GC する。
+    void collect(size_t max_items, std::vector<int> &batch, GcStats *st) {
+        Timestamp ts0 = gc_ts.load();
+        Timestamp ts = tsg->min_active_timestamp();
+        if (ts-ts0 <= GC_ADVANCE || !gc_ts.compare_exchange_strong(ts0,ts)) return;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            size_t n = std::min(max_items, queue.size());
+            batch.assign(queue.begin(), queue.begin()+n);
+            queue.erase(queue.begin(), queue.begin()+n);
+        }
+        if (batch.empty()) return;
+        DPRINTF("\nGC: ts=%ld n=%ld\n",ts,batch.size());
+        Timer timer;
+        for (int key : batch) {
+            dirty[key].store(false);
+            if (database[key].gc(ts)) {
+                mark_dirty(key);
+            }
+        }
+        double t = timer.get_time();
+        st->n_sweep++;
+        st->n_item += batch.size();
+        st->t_total += t;
+        if (t > st->t_max) st->t_max = t;
+    }
+
+public:
+    static const int GC_INTERVAL = 16;
+    static const int GC_BATCH = 16;
+    static const Timestamp GC_ADVANCE = 10000L << TS_THREAD_BITS;  // cycles
+
+    GarbageCollector(DataItem *database, TimeStampGenerator *tsg)
+        : database(database), tsg(tsg) {
+        for (int i=0; i<NUM_DATA; i++) {
+            dirty[i].store(false);
+        }
+    }
+
+    void mark_dirty(int key) {
+        if (dirty[key].load() || dirty[key].exchange(true)) return;
+        std::lock_guard<std::mutex> lock(mtx);
+        queue.push_back(key);
+    }
+
+    // called by a worker inside its epoch after each commit
+    void step(int n_commit, std::vector<int> &batch, GcStats *st) {
+        if (n_commit % GC_INTERVAL != 0) return;
+        batch.clear();
+        collect(GC_BATCH, batch, st);
+    }
+};
+
+
+// xacts: TX_LEN ops per transaction
+void worker(int thread_id, XACT *xacts,
+            DataItem *database, TimeStampGenerator *tsg, GarbageCollector *gc,
+            ThreadResult *result)
+{
+    Timer timer;
+    double t_elap;
+    int n_abort=0;
+    int n_read_only=0;
+    long n_version=0;
+    long n_inlined=0;
+    GcStats gc_stats = {};
+    std::vector<int> gc_batch;
+    std::vector<std::pair<VersionValue*,bool>> installed;
+    CONFLICTS conflicts;
+    conflict_init(&conflicts);
+#if HISTORY
+    HIST_BUF hist;
+    hist_init(&hist, thread_id);
+#endif
+
+    epoch.register_thread(thread_id);
+
+    for (int repeat=0; repeat < N_REPEAT; repeat++) {
+        std::vector<XACT> xact(xacts + repeat*TX_LEN, xacts + (repeat+1)*TX_LEN);
+        bool read_only = std::none_of(xact.begin(), xact.end(),
+                                      [](const XACT &x) {return x.type == WRITE;});
+    retry:
+        epoch.enter();
+        Timestamp ts = read_only ? tsg->get_snapshot(thread_id)
+                                 : tsg->get_timestamp(thread_id);
+        std::unordered_map<int,Value> values;
+        std::unordered_map<int,VersionValue*> reads;
+        std::map<int,Value> writes;
+        int conflict_cause = CF_LATE_WRITE, conflict_key = -1;
+        Timestamp conflict_with = -1;
+
+        // Read phase
+        for (int i=0; i<TX_LEN; i++) {
+            int key = xact[i].key;
+            int type = xact[i].type;
+            Value v;
+            if (type == READ) {
+                // 自分の書き込みはまだ database にないので write set から読む
+                auto w = writes.find(key);
+                if (w != writes.end()) {
+                    values[key] = v = w->second + 1;
+                    continue;
+                }
+                auto r = reads.find(key);
+                VersionValue *x = (r != reads.end()) ? r->second : database[key].read(ts);
+                reads[key] = x;
+                values[key] = v = x->value + 1;
+            }
+            if (type == WRITE) {
+                auto itr = values.find(key);
+                v = (itr == values.end()) ? 0 : values[key];
+                writes[key] = v;
+            }
+        }
+        if (read_only) {
+            n_read_only++;
+            goto commit;
+        }
+
+        // Validation phase
+        //  1. write set を pending で加える
+        //  2. read set の rts を ts まで上げる
+        //  3. 読んだバージョンが ts で見えるままか、書いたバージョンの直前が
+        //     ts より後に読まれていないかを確認する
+        installed.clear();
+        for (auto &w : writes) {
+            bool inlined = false;
+            VersionValue *x = database[w.first].install(ts, w.second, &inlined, &conflict_with);
+            gc->mark_dirty(w.first);
+            if (x == NULL) {
+                conflict_key = w.first;
+                goto abort;
+            }
+            installed.emplace_back(x,inlined);
+        }
+        for (auto &r : reads) {
+            DataItem::update_rts(ts, r.second);
+        }
+        for (auto &r : reads) {
+            if (!database[r.first].is_visible(ts, r.second, &conflict_with)) {
+                conflict_cause = CF_VALIDATE;
+                conflict_key = r.first;
+                goto abort;
+            }
+        }
+        {
+            // installed は writes と同じキーの順
+            auto w = writes.begin();
+            for (auto &m : installed) {
+                if (!DataItem::check_pred(ts, m.first, &conflict_with)) {
+                    conflict_key = w->first;
+                    goto abort;
+                }
+                ++w;
+            }
+        }
+        for (auto &m : installed) {
+            m.first->status.store(COMMITTED);
+            n_version++;
+            if (m.second) n_inlined++;
+        }
+
+    commit:
+#if HISTORY
+        // 読んだバージョンは epoch を出るまで回収されない
+        hist_begin(&hist, read_only ? ts-1 : ts);
+        for (auto &r : reads) hist_read(&hist, r.first, r.second->version);
+        for (auto &w : writes) hist_write(&hist, w.first, ts);
+        hist_commit(&hist);
+#endif
+        tsg->transaction_end(thread_id);
+        gc->step(repeat+1, gc_batch, &gc_stats);
+        epoch.exit();
+        continue;
+
+    abort:
+        for (auto &m : installed) {
+            m.first->status.store(ABORTED);
+        }
+        conflict_add(&conflicts, conflict_cause, conflict_key, conflict_with);
+        n_abort++;
+        tsg->transaction_end(thread_id);
+        epoch.exit();
+        std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+        goto retry;
+    }
+    result->t_elap = t_elap = timer.get_time();
+#if HISTORY
+    hist_finish(&hist);
+#endif
+    result->n_abort = n_abort;
+    result->n_commit = N_REPEAT;
+    result->n_read_only = n_read_only;
+    result->n_version = n_version;
+    result->n_inlined = n_inlined;
+    result->gc = gc_stats;
+    printf("thread%d: throughput=%f[tpx] time=%f[s] n_abort=%d abort_ratio=%f\n",
+           thread_id,N_REPEAT/t_elap,t_elap,n_abort,n_abort*1.0/N_REPEAT);
+    conflict_report(&conflicts, thread_id);
+}
+
+
+int main(int argc, char *argv[]){
+    int sum;
+    std::vector<std::vector<XACT>> xact;
+    XACT *thread_xact[NUM_THREADS];
+    std::mt19937 mt;
+    std::uniform_int_distribution<> rand_percent(0,99);
+    std::uniform_int_distribution<> rand_key(0,NUM_DATA-1);
+
+    // Create Transaction
+    sum = 0;
+    if (argc > 1) {
+        // replay the trace argv[1] instead of generating the transactions
+        const TRACE_HEADER *h = trace_open(argv[1], NUM_THREADS, TX_LEN, N_REPEAT, NUM_DATA);
+        for (int i=0; i<NUM_THREADS; i++) {
+            thread_xact[i] = TRACE_XACT(h, i);
+        }
+        sum = trace_n_read(h, NUM_THREADS, N_REPEAT);
+    } else {
+        xact.assign(NUM_THREADS, std::vector<XACT>(N_REPEAT*TX_LEN));
+        for(int i=0; i<NUM_THREADS; i++){
+            DPRINTF("thread%d:",i);
+            for(int j=0; j<N_REPEAT; j++){
+                for (int k=0; k<TX_LEN; k++) {
+                    XACT &x = xact[i][j*TX_LEN+k];
+                    x.type = (rand_percent(mt) < WRITE_PERCENT) ? WRITE : READ;
+                    x.key = rand_key(mt);
+                    DPRINTF("%s%d",(x.type==READ) ? "r":"w",x.key);
+                    if (x.type==READ) {
+                        sum += 1;
+                    }
+                }
+                DPRINTF(" ");
+            }
+            DPRINTF("\n");
+            thread_xact[i] = xact[i].data();
+        }
+    }
+
+    DataItem database[NUM_DATA];
+    TimeStampGenerator tsg;
+    GarbageCollector gc(database, &tsg);
+
+#if HISTORY
+    hist_open();
+#endif
+    std::vector<std::thread> thv;
+    ThreadResult result[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        thv.emplace_back(worker, i, thread_xact[i], database, &tsg, &gc, &result[i]);
+    }
+
+    for (auto& th : thv) th.join();
+    conflict_report_total();
+#if HISTORY
+    hist_close();
+    printf("history: %s\n", HISTORY_FILE);
+#endif
+
+    std::cout << std::endl;
+    for (int i=0; i<NUM_DATA; i++) {
+        printf("data:%d\n",i);
+        database[i].print();
+    }
+    int n_abort=0;
+    int n_commit=0;
+    int n_read_only=0;
+    long n_version=0;
+    long n_inlined=0;
+    double t_elap=0;
+    GcStats gc_stats = {};
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        n_commit += result[i].n_commit;
+        n_read_only += result[i].n_read_only;
+        n_version += result[i].n_version;
+        n_inlined += result[i].n_inlined;
+        t_elap += result[i].t_elap;
+        n_abort += result[i].n_abort;
+        gc_stats.n_sweep += result[i].gc.n_sweep;
+        gc_stats.n_item += result[i].gc.n_item;
+        gc_stats.t_total += result[i].gc.t_total;
+        if (result[i].gc.t_max > gc_stats.t_max) gc_stats.t_max = result[i].gc.t_max;
+    }
+    printf("write_percent=%d read_only=%d versions=%ld inlined=%ld(%f)\n",
+           WRITE_PERCENT,n_read_only,n_version,n_inlined,
+           n_version ? 1.0*n_inlined/n_version : 0.0);
+    printf("gc(worker): n_sweep=%d n_item=%ld time=%f max_pause=%f\n",
+           gc_stats.n_sweep,gc_stats.n_item,gc_stats.t_total,gc_stats.t_max);
+    printf("throughput=%f[tpx] total_time=%f n_abort=%d abort_ratio=%f gc_count=%d\n",
+           n_commit/t_elap*NUM_THREADS,t_elap,n_abort,1.0*n_abort/n_commit,gc_stats.n_sweep);
+
+    return 0;
+}
@@ -1,19 +1,121 @@
 /* g++ ex1.cpp -o ex1 -g -std=c++17 -W -Wall -lpthread  */
 
 #include <atomic>
+#include <climits>
+#include <algorithm>
 #include <chrono>
+#include <deque>
 #include <functional>
 #include <iostream>
-#include <list>
 #include <mutex>
 #include <random>
-#include <shared_mutex>
 #include <thread>
 #include <unordered_map>
 #include <vector>
+#include <x86intrin.h>
+#include "../trace/trace.h"
 
 #define DEBUG 0
 
+// read timestamp tracking
+//  0: ReadRange list ri[xj] per item, write() scans the whole list
+//  1: max read timestamp in each VersionValue, write() checks only the
+//     preceding version
+#ifndef VERSION_RTS
+#define VERSION_RTS 0
+#endif
+
+// garbage collection of the items in the dirty queue
+//  0: workers collect a few items after their commits
+//  n: n background threads
+#ifndef GC_THREADS
+#define GC_THREADS 0
+#endif
+
+// timestamps taken from global_ts at once by each thread
+#ifndef TS_BATCH
+#define TS_BATCH 1
+#endif
+
+// 1: writes are buffered and installed at commit as pending versions,
+//    which are marked committed (or aborted) at the end of the transaction
+// 0: write() installs a visible version during the read phase (aborted
+//    transactions' versions stay readable, so HISTORY shows dirty reads)
+#ifndef DEFERRED_WRITE
+#define DEFERRED_WRITE 1
+#endif
+
+// isolation level
+//  SERIALIZABLE:   MVTO
+//  SNAPSHOT:       reads see the versions committed before the transaction
+//                  began; a write aborts if its item has a version committed
+//                  since then (first-committer-wins)
+//  READ_COMMITTED: reads see the newest committed version; writes never abort
+// SNAPSHOT and READ_COMMITTED install the write set in key order at commit,
+// waiting for a version another transaction is committing, and version it by
+// a commit timestamp taken afterwards, so they need DEFERRED_WRITE.
+#define SERIALIZABLE 0
+#define SNAPSHOT 1
+#define READ_COMMITTED 2
+#ifndef ISOLATION
+#define ISOLATION SERIALIZABLE
+#endif
+#if ISOLATION != SERIALIZABLE && !DEFERRED_WRITE
+#error "ISOLATION=SNAPSHOT/READ_COMMITTED needs DEFERRED_WRITE"
+#endif
+
+// 1: jump pointers in the version chain, so finding the version for an old
+//    timestamp is O(log versions)
+#ifndef VERSION_INDEX
+#define VERSION_INDEX 1
+#endif
+
+// threads running long read-only transactions (LONG_READ_PASSES scans over
+// all items with one timestamp) next to the short transactions
+#ifndef LONG_READERS
+#define LONG_READERS 0
+#endif
+#ifndef LONG_READ_PASSES
+#define LONG_READ_PASSES 10
+#endif
+
+// n: each worker interleaves n transactions as C++20 coroutines (-std=c++20).
+//    A transaction prefetches a record and yields to the next one before
+//    touching it, so the cache misses of the n transactions overlap.
+#ifndef COROUTINES
+#define COROUTINES 0
+#endif
+#if COROUTINES
+#include <coroutine>
+#endif
+// 1: before each transaction, prefetch the version-chain heads of its items
+//    and the items of the next transaction
+#ifndef PREFETCH
+#define PREFETCH 0
+#endif
+
+// 1: committed transactions を HISTORY_FILE に記録する (history/check 用)。
+//    read は読んだバージョン、write は自分の timestamp (SNAPSHOT と
+//    READ_COMMITTED では commit timestamp) を version とする。
+//    自分の write set からの read と LONG_READERS は記録しない。
+#ifndef HISTORY
+#define HISTORY 0
+#endif
+#if HISTORY
+#include "../history/history.h"
+#endif
+
+// 1: read, write (commit), backoff, GC の phase ごとの cycles、
+// 2: phase ごとの perf counter も (phase/phase.h)
+#ifndef PHASE_STATS
+#define PHASE_STATS 0
+#endif
+#include "../phase/phase.h"
+#include "../conflict/conflict.h"
+
+// timestamp slots per worker: one per interleaved transaction
+#define TS_SLOTS (COROUTINES > 0 ? COROUTINES : 1)
+
 #if DEBUG
 #define N_TRANSACTION 1200
 #define NUM_THREADS 4
@@ -22,8 +124,12 @@
 #define DPRINTF(...) std::printf(__VA_ARGS__)
 #else
 #define N_TRANSACTION 280000
+#ifndef NUM_THREADS
 #define NUM_THREADS 28
+#endif
+#ifndef NUM_DATA
 #define NUM_DATA 50
+#endif
 #define TX_LEN 10
 #define DPRINTF(...) {}
 #endif
@@ -42,67 +148,447 @@ typedef struct _XACT {
     TYPE type;
 } XACT;
 
+typedef enum {COMMITTED=0, PENDING=1, ABORTED=2} STATUS;
+
+// version of a pending write until its commit timestamp is taken
+#define PENDING_TS INT_MAX
+
 typedef struct _VersionValue {
     int version;
     Value value;
     std::atomic<struct _VersionValue*> next;
+#if VERSION_RTS
+    std::atomic<int> rts;   // max timestamp of the transactions that read this version
+#endif
+#if DEFERRED_WRITE
+    std::atomic<int> status;
+#endif
+#if VERSION_INDEX
+    int depth;                    // position from list_end
+    int jump_ver;                 // jump->version
+    int jump_depth;               // jump->depth
+    struct _VersionValue *jump;
+#endif
 } VersionValue;
 
+static void init_version(VersionValue *x, int version, Value value, VersionValue *next)
+{
+    x->version = version;
+    x->value = value;
+    x->next.store(next);
+#if VERSION_RTS
+    x->rts.store(0);
+#endif
+#if DEFERRED_WRITE
+    x->status.store(COMMITTED);
+#endif
+#if VERSION_INDEX
+    x->depth = 0;
+    x->jump_ver = 0;
+    x->jump_depth = 0;
+    x->jump = x;
+#endif
+}
+
 typedef struct _ReadRange {
     int wr_ver;
     int rd_ts;
     std::atomic<struct _ReadRange*> next;
 } ReadRange;
 
+typedef struct _GcStats {
+    int n_sweep;     // gc passes
+    long n_item;     // DataItem::gc() calls
+    double t_total;  // time spent in gc passes
+    double t_max;    // longest gc pass
+} GcStats;
+
 typedef struct _ThreadResult {
     double t_elap;
     int n_abort;
+    int n_commit;
+    long ts_cycles;  // cycles spent in get_timestamp()
+    GcStats gc;
 } ThreadResult;
 
 
+class Timer {
+    struct timespec start_time;
+public:
+    Timer() {clock_gettime(CLOCK_MONOTONIC, &start_time);}
+
+    double get_time()
+    {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec - start_time.tv_sec + (t.tv_nsec - start_time.tv_nsec)/1e9;
+    }
+};
+
+
+// Per-thread slab allocator for version chain nodes.
+// alloc() is a pointer bump (or a pop from the free list), free() pushes the
+// node back to the free list of the calling thread.  Slabs are never returned
+// to the OS because nodes are still printed by main() after the workers exit.
+// A thread that frees but never allocates (the GC thread) hands its free list
+// to the others through shared_free with donate().
+template <typename T>
+class SlabPool {
+    static const int SLAB_NODES = 4096;
+    struct FreeNode {
+        FreeNode *next;
+    };
+    static_assert(sizeof(T) >= sizeof(FreeNode), "node too small");
+    static inline std::atomic<FreeNode*> shared_free{NULL};
+    char *slab_ptr = NULL;
+    char *slab_end = NULL;
+    FreeNode *free_list = NULL;
+public:
+    T *alloc() {
+        if (free_list == NULL && shared_free.load() != NULL) {
+            // take the whole stack, so there is no ABA problem
+            free_list = shared_free.exchange(NULL);
+        }
+        if (free_list != NULL) {
+            FreeNode *p = free_list;
+            free_list = p->next;
+            return (T*)p;
+        }
+        if (slab_ptr == slab_end) {
+            slab_ptr = (char*)malloc(sizeof(T)*SLAB_NODES);
+            slab_end = slab_ptr + sizeof(T)*SLAB_NODES;
+        }
+        T *p = (T*)slab_ptr;
+        slab_ptr += sizeof(T);
+        return p;
+    }
+
+    void free(T *p) {
+        FreeNode *f = (FreeNode*)p;
+        f->next = free_list;
+        free_list = f;
+    }
+
+    void donate() {
+        if (free_list == NULL) return;
+        FreeNode *tail = free_list;
+        while (tail->next != NULL) {
+            tail = tail->next;
+        }
+        FreeNode *top = shared_free.load();
+        do {
+            tail->next = top;
+        } while (!shared_free.compare_exchange_weak(top,free_list));
+        free_list = NULL;
+    }
+};
+
+
+// Epoch-based reclamation.
+// A worker is inside an epoch for each transaction attempt, including its GC
+// step after the commit; a GC thread for each pass over its batch.
+// Chains cut off by gc() are retired into the limbo list of the current
+// epoch and returned to the slab pool once every worker has left that epoch,
+// so read()/write() can walk the chains without taking a lock.
+class EpochManager {
+    struct alignas(64) LocalEpoch {
+        std::atomic<unsigned long> epoch{0};  // 0: quiescent
+    };
+    struct Limbo {
+        unsigned long epoch = 0;
+        std::vector<VersionValue*> versions;
+        std::vector<ReadRange*> ranges;
+    };
+    struct alignas(64) ThreadState {
+        SlabPool<VersionValue> version_pool;
+        SlabPool<ReadRange> range_pool;
+        Limbo limbo[3];
+        int n_exit = 0;
+    };
+    alignas(64) std::atomic<unsigned long> global_epoch{1};
+    LocalEpoch local[NUM_THREADS+GC_THREADS];
+    ThreadState state[NUM_THREADS+GC_THREADS];
+    static thread_local int thread_id;
+
+    void try_advance() {
+        unsigned long e = global_epoch.load();
+        for (int i=0; i<NUM_THREADS+GC_THREADS; i++) {
+            unsigned long l = local[i].epoch.load();
+            if (l != 0 && l != e) return;
+        }
+        global_epoch.compare_exchange_strong(e, e+1);
+    }
+
+    void reclaim(ThreadState &st) {
+        unsigned long e = global_epoch.load();
+        for (auto &lb : st.limbo) {
+            // nodes retired in epoch e0 are unreachable once global_epoch >= e0+2
+            if (lb.epoch + 2 > e) continue;
+            for (auto x : lb.versions) {
+                for (VersionValue *y; (y = x->next.load()) != NULL; x = y) {
+                    st.version_pool.free(x);
+                }
+            }
+            for (auto x : lb.ranges) {
+                for (ReadRange *y; (y = x->next.load()) != NULL; x = y) {
+                    st.range_pool.free(x);
+                }
+            }
+            lb.versions.clear();
+            lb.ranges.clear();
+        }
+    }
+
+    Limbo &current_limbo(ThreadState &st) {
+        unsigned long e = global_epoch.load();
+        Limbo &lb = st.limbo[e % 3];
+        if (lb.epoch != e) {
+            reclaim(st);
+            lb.epoch = e;
+        }
+        return lb;
+    }
+
+public:
+    void register_thread(int id) {
+        thread_id = id;
+    }
+
+    void enter() {
+        local[thread_id].epoch.store(global_epoch.load());
+        reclaim(state[thread_id]);
+    }
+
+    void exit() {
+        local[thread_id].epoch.store(0);
+        if (++state[thread_id].n_exit % 64 == 0) {
+            try_advance();
+        }
+    }
+
+    VersionValue *alloc_version() {
+        return state[thread_id].version_pool.alloc();
+    }
+
+    ReadRange *alloc_range() {
+        return state[thread_id].range_pool.alloc();
+    }
+
+    void free_version(VersionValue *x) {
+        state[thread_id].version_pool.free(x);
+    }
+
+    void free_range(ReadRange *x) {
+        state[thread_id].range_pool.free(x);
+    }
+
+    void donate() {
+        state[thread_id].version_pool.donate();
+        state[thread_id].range_pool.donate();
+    }
+
+    // x: first node of a chain cut off by gc(), terminated by the sentinel
+    void retire_versions(VersionValue *x) {
+        current_limbo(state[thread_id]).versions.push_back(x);
+        try_advance();
+    }
+
+    void retire_ranges(ReadRange *x) {
+        current_limbo(state[thread_id]).ranges.push_back(x);
+        try_advance();
+    }
+};
+
+thread_local int EpochManager::thread_id = 0;
+
+EpochManager epoch;
+
+
 class DataItem {
-    VersionValue list_end = {0,0,NULL};
-    VersionValue list_begin = {0,0,&list_end};
+    VersionValue list_end;
+    VersionValue list_begin;
+#if !VERSION_RTS
     ReadRange range_end = {0,0,NULL};
     ReadRange range_begin = {0,0,&range_end};
-    std::shared_mutex mtx;
+#endif
+
+#if VERSION_INDEX
+    // gc() がこれより古いバージョンを回収したかもしれない
+    static inline std::atomic<int> cut_ts{0};
+
+    // Myers の jump pointer。p の jump と p->jump の jump の深さの差が等しければ
+    // 2 段先へ、そうでなければ p へ飛ぶ。途中に挿入されても、飛ばすバージョンは
+    // すべて jump_ver より新しいので探索は正しい。
+    // cut_ts より古い jump 先は再利用されたかもしれないので読まない。
+    static void set_jump(VersionValue *m, VersionValue *p) {
+        VersionValue *j = p->jump;
+        m->depth = p->depth + 1;
+        if (p->jump_ver >= cut_ts.load() &&
+            p->depth - p->jump_depth == p->jump_depth - j->jump_depth) {
+            m->jump = j->jump;
+            m->jump_ver = j->jump_ver;
+            m->jump_depth = j->jump_depth;
+        } else {
+            m->jump = p;
+            m->jump_ver = p->version;
+            m->jump_depth = p->depth;
+        }
+    }
+#endif
+
+    // timestamp 以下で最新のバージョン (pending, aborted を含む)
+    VersionValue *find(int timestamp) {
+        VersionValue *x = list_begin.next.load();
+        while (x->version > timestamp) {
+#if VERSION_INDEX
+            if (x->jump_ver > timestamp) {
+                x = x->jump;
+                continue;
+            }
+#endif
+            x = x->next.load();
+        }
+        return x;
+    }
+
+#if DEFERRED_WRITE
+    // pending のバージョンは commit/abort が決まるまで待ち、abort されたものは
+    // 飛ばして、x 以下で最新の committed バージョンを返す。
+    static VersionValue *committed(VersionValue *x) {
+        for (;; x = x->next.load()) {
+            int st;
+            while ((st = x->status.load()) == PENDING) {
+                std::this_thread::yield();
+            }
+            if (st == COMMITTED) return x;
+        }
+    }
+#endif
+
 public:
     //DataItem() : DataItem(0) {}
     //DataItem(Value value) : list(0), read_range(0), v0(value) {}
+    DataItem() {
+        init_version(&list_end,0,0,NULL);
+        init_version(&list_begin,0,0,&list_end);
+    }
+
+#if ISOLATION != SERIALIZABLE
+    // SNAPSHOT: commit timestamp が timestamp 以下で最新の committed バージョン。
+    // pending のバージョンは commit timestamp が決まるまで待つ。
+    // READ_COMMITTED: 最新の committed バージョン。pending は待たずに飛ばす。
+    Value read(int timestamp, int *version = NULL) {
+        for (VersionValue *x = list_begin.next.load(); ; x = x->next.load()) {
+            int st;
+            while ((st = x->status.load()) == PENDING && ISOLATION == SNAPSHOT) {
+                std::this_thread::yield();
+            }
+            if (st == COMMITTED && (ISOLATION == READ_COMMITTED || x->version <= timestamp)) {
+                if (version != NULL) *version = x->version;
+                return x->value;
+            }
+        }
+    }
+
+    // write set を version=PENDING_TS の pending バージョンとして先頭に加える。
+    // 最新のバージョンが他のトランザクションの pending なら、その commit/abort を
+    // 待つ。write set はキーの順に入れるので、待ち合いは循環しない。
+    // SNAPSHOT では timestamp より後に commit されたバージョンがあれば abort する
+    // (first-committer-wins)。そのバージョンを *with に返す。
+    bool install(int timestamp, Value value, VersionValue **installed, int *with = NULL) {
+        VersionValue *m = NULL;
+        for (;;) {
+            VersionValue *x = list_begin.next.load();
+            VersionValue *y = x;
+            int st;
+            while ((st = y->status.load()) != COMMITTED) {
+                if (st == ABORTED) {
+                    y = y->next.load();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            if (ISOLATION == SNAPSHOT && y->version > timestamp) {
+                if (with != NULL) *with = y->version;
+                if (m != NULL) {
+                    epoch.free_version(m);
+                }
+                return false;
+            }
+            if (m == NULL) {
+                m = epoch.alloc_version();
+                init_version(m,PENDING_TS,value,x);
+                m->status.store(PENDING);
+            }
+            m->next.store(x);
+#if VERSION_INDEX
+            set_jump(m,x);
+#endif
+            if (list_begin.next.compare_exchange_weak(x,m)) break;
+        }
+        *installed = m;
+        return true;
+    }
+
+    // install() したバージョンの commit/abort。abort したバージョンは次の
+    // バージョンと同じ version にして、chain の version の順序を保つ。
+    static void commit_version(VersionValue *x, int commit_ts) {
+        x->version = commit_ts;
+        x->status.store(COMMITTED);
+    }
 
-    Value read(int timestamp) {
+    static void abort_version(VersionValue *x) {
+        x->version = x->next.load()->version;
+        x->status.store(ABORTED);
+    }
+#else
+    // version: 読んだバージョンを返す (NULL なら返さない)
+    Value read(int timestamp, int *version = NULL) {
         // timestamp=7 のトランザクションが x を読むとする。
-        std::shared_lock<std::shared_mutex> lock(mtx);
-        VersionValue *x = list_begin.next.load();
-        // read first_item == max_version
+    retry_read:
         // listの先頭が最大バージョンである。
-        Value value = x->value;
-        int ver = x->version;
         // timestamp=7 より新しいバージョン x9 が書かれている場合
         // 7より小さい最大のバージョン x3 を見つけて読む。
-        for ( ; x != NULL; x = x->next.load()) {
-            if (x->version <= timestamp) {
-                value = x->value;
-                ver = x->version;
-                break;
-            }
+        VersionValue *x = find(timestamp);
+#if DEFERRED_WRITE
+        x = committed(x);
+#endif
+        Value value = x->value;
+        int ver = x->version;
+#if VERSION_RTS
+        // x3.rts = max(x3.rts, 7)
+        DPRINTF("r%d(x%d)",timestamp,ver);
+        int rts = x->rts.load();
+        while (rts < timestamp && !x->rts.compare_exchange_weak(rts,timestamp)) {}
+        // rts を上げる前に x3 と 7 の間のバージョン x5 が書かれていたら読み直す。
+        // write() は x5 を加えた後で x3.rts を確認するので、どちらかが必ず気付く。
+        VersionValue *y = find(timestamp);
+#if DEFERRED_WRITE
+        while (y->status.load() == ABORTED) {
+            y = y->next.load();
         }
+#endif
+        if (y->version != ver) goto retry_read;
+#else
         // record ri[xj], i=rd_ts, j=wr_ver
         // x3 を読むとき、r7[x3] を ReadRange に加える。
         DPRINTF("r%d(x%d)",timestamp,ver);
+        ReadRange *m = NULL;
         for (auto i = &range_begin; ; i=i->next.load()) {
         retry:
             ReadRange *x = i->next.load();
             if (x->next.load() == NULL || x->wr_ver < ver) {
-                ReadRange *m = (ReadRange *)malloc(sizeof(ReadRange));
-                m->wr_ver = ver;
-                m->rd_ts = timestamp;
+                if (m == NULL) {
+                    m = epoch.alloc_range();
+                    m->wr_ver = ver;
+                    m->rd_ts = timestamp;
+                }
                 m->next.store(x);
                 bool b = i->next.compare_exchange_weak(x,m);
                 if (!b) {
-                    free(m);
                     goto retry;
                 }
+                m = NULL;
                 break;
             } else
             if (x->wr_ver == ver) {
@@ -113,180 +599,482 @@ public:
                 break;
             }
         }
+        if (m != NULL) {
+            epoch.free_range(m);
+        }
+        // r7[x3] を加える前に x5 が書かれていたら読み直す。write() は x5 を
+        // 加えた後で ReadRange を確認するので、どちらかが必ず気付く。
+        VersionValue *y = find(timestamp);
+#if DEFERRED_WRITE
+        while (y->status.load() == ABORTED) {
+            y = y->next.load();
+        }
+#endif
+        if (y->version != ver) goto retry_read;
+#endif
+        if (version != NULL) *version = ver;
         return value;
     }
+#endif
 
-    bool write(int timestamp, Value value) {
-        std::shared_lock<std::shared_mutex> lock(mtx);
+    // DEFERRED_WRITE: 加えたバージョンは pending のまま *installed に返す。
+    // 呼び出し側が commit/abort を決めて status を書く。
+    // abort するときは後で読んだトランザクションの timestamp を *with に返す。
+    bool write(int timestamp, Value value, VersionValue **installed, int *with = NULL) {
+#if !DEFERRED_WRITE
+        (void)installed;
+#endif
         // If a step of the form rj(xk) such that ts(tk) < ts(ti) < ts(tj)
         // has already been scheduled, then wi(x) is rejected and ti is aborted.
+#if !VERSION_RTS
         for (auto itr = range_begin.next.load(); itr != NULL; itr=itr->next.load()) {
             // ri[xj], j=wr_ver < timestamp < i=rd_ts
             if (itr->wr_ver < timestamp && timestamp < itr->rd_ts) {
                 DPRINTF("(abort %d<%d<%d)\n", itr->wr_ver, timestamp, itr->rd_ts);
+                if (with != NULL) *with = itr->rd_ts;
                 return false;
             }
         }
+#endif
         // abortしなければ VersionValue のリストに加える
+        VersionValue *m = NULL;
         for (auto itr = &list_begin;; ) {
             retry:
             VersionValue *x = itr->next.load();
             if (x->version < timestamp) {
-                VersionValue *m = (VersionValue *)malloc(sizeof(VersionValue));
-                m->version = timestamp;
-                m->value = value;
+#if VERSION_RTS
+                // 直前のバージョン xk。xk.rts > timestamp なら abort
+#if DEFERRED_WRITE
+                VersionValue *pred = committed(x);
+#else
+                VersionValue *pred = x;
+#endif
+                if (pred->rts.load() > timestamp) {
+                    DPRINTF("(abort %d<%d<%d)\n", pred->version, timestamp, pred->rts.load());
+                    if (with != NULL) *with = pred->rts.load();
+                    if (m != NULL) {
+                        epoch.free_version(m);
+                    }
+                    return false;
+                }
+#endif
+                if (m == NULL) {
+                    m = epoch.alloc_version();
+                    init_version(m,timestamp,value,x);
+#if DEFERRED_WRITE
+                    m->status.store(PENDING);
+                    *installed = m;
+#endif
+                }
                 m->next.store(x);
+#if VERSION_INDEX
+                set_jump(m,x);
+#endif
                 bool b = itr->next.compare_exchange_weak(x,m);
                 if (!b) {
-                    free(m);
                     goto retry;
                 }
+#if !VERSION_RTS
+                // 挿入の前に r[xk] を加えた後のトランザクションがいないか再確認する
+                for (auto r = range_begin.next.load(); r != NULL; r=r->next.load()) {
+                    if (r->wr_ver < timestamp && timestamp < r->rd_ts) {
+                        DPRINTF("(abort %d<%d<%d)\n", r->wr_ver, timestamp, r->rd_ts);
+                        if (with != NULL) *with = r->rd_ts;
+#if DEFERRED_WRITE
+                        m->status.store(ABORTED);
+#endif
+                        return false;
+                    }
+                }
+#endif
+#if VERSION_RTS
+                // 挿入の前に xk を読んだ後のトランザクションがいないか再確認する
+                if (pred->rts.load() > timestamp) {
+                    DPRINTF("(abort %d<%d<%d)\n", pred->version, timestamp, pred->rts.load());
+                    if (with != NULL) *with = pred->rts.load();
+#if DEFERRED_WRITE
+                    m->status.store(ABORTED);
+#endif
+                    return false;
+                }
+#endif
                 break;
             } else
             if (x->version == timestamp) {
                 x->value = value;
-                return true;
+#if DEFERRED_WRITE
+                *installed = x;
+#endif
+                break;
             }
             itr = x;
         }
         return true;
     }
 
-    void gc(int timestamp) {
-        // timestamp より小さい item を削除する。
-        std::lock_guard<std::shared_mutex> lock(mtx);
-        for (auto itr = list_begin.next.load();; ) {
-            VersionValue *x = itr->next.load();
-            if (x == NULL) break;
-            if (x->version < timestamp) {
-                bool b = itr->next.compare_exchange_weak(x,&list_end);
-                if (!b) return;
-                for (;;) {
-                    auto y = x->next.load();
-                    if (y == NULL) break;
-                    //printf("[0x%lx,%d,%d]",(long)x,x->version,x->value);fflush(stdout);
-                    free(x);
-                    x = y;
-                }
-            }
-            itr = x;
+    // 戻り値: xk より新しいバージョンが残っている (後の GC で消せる) なら true
+    bool gc(int timestamp) {
+        // timestamp 以下の最大バージョン xk は timestamp のトランザクションが
+        // まだ読むので残し、それより古い item を削除する。
+        // 切り離したリストは epoch に渡し、全 worker が抜けた後で再利用する。
+        VersionValue *keep = find(timestamp);
+#if DEFERRED_WRITE
+        // abort されたバージョンは読まれないので、その下の committed を残す
+        while (keep->status.load() != COMMITTED) {
+            keep = keep->next.load();
+        }
+#endif
+        if (keep->next.load() == NULL) { // list_end
+            return list_begin.next.load() != keep;
         }
-        for (auto itr = range_begin.next.load();; ) {
+        VersionValue *x = keep->next.load();
+        if (x->next.load() != NULL) {
+#if VERSION_INDEX
+            int ts = cut_ts.load();
+            while (ts < timestamp && !cut_ts.compare_exchange_weak(ts,timestamp)) {}
+#endif
+            if (!keep->next.compare_exchange_strong(x,&list_end)) return true;
+            epoch.retire_versions(x);
+        }
+#if !VERSION_RTS
+        // ri[xj] (j < k) は xj とともに不要になる
+        int ver = keep->version;
+        for (ReadRange *itr = &range_begin;; ) {
             ReadRange *x = itr->next.load();
-            if (x == NULL) break;
-            if (x->wr_ver < timestamp) {
-                bool b=itr->next.compare_exchange_weak(x,&range_end);
-                if (!b) return;
-                for (;;) {
-                    auto y = x->next.load();
-                    if (y == NULL) break;
-                    //printf(" 0x%lx ",(long)x);;fflush(stdout);
-                    free(x);
-                    x = y;
+            if (x->next.load() == NULL) break;
+            if (x->wr_ver < ver) {
+                if (itr->next.compare_exchange_strong(x,&range_end)) {
+                    epoch.retire_ranges(x);
                 }
+                break;
             }
             itr = x;
         }
+#endif
+        return list_begin.next.load() != keep;
+    }
+
+    // prefetch 用: read/write が最初に触る list_begin と、最新のバージョン
+    const void *head() const {
+        return &list_begin;
+    }
+
+    const VersionValue *newest() const {
+        return list_begin.next.load();
     }
 
     void print() {
+#if VERSION_RTS
+        printf("ver:val:rts(n=%ld){",0L);
+#else
         printf("ver:val(n=%ld){",0L);
+#endif
         for (auto x = list_begin.next.load(); x != NULL; x = x->next.load()) {
+#if VERSION_RTS
+            printf("%d:%d:%d,",x->version,x->value,x->rts.load());
+#else
             printf("%d:%d,",x->version,x->value);
+#endif
         }
         printf("}\n");
+#if !VERSION_RTS
         printf("ri[xj](n=%ld){", 0L);
         for (auto x = range_begin.next.load(); x != NULL; x = x->next.load()) {
             printf("%d:%d,",x->rd_ts,x->wr_ver);
         }
         printf("}\n");
+#endif
     }
 };
 
 
+// 実行中のトランザクションの timestamp をスレッドごとのスロットに置く。
+// 開始/終了は自スレッドのスロットだけを書き、GC 用の最小値 (watermark) は
+// 必要になったときに全スロットを読んで求める。
+// TS_BATCH > 1 のときは global_ts から TS_BATCH 個ずつまとめて取り、
+// スレッド内で順に使うので、共有の fetch_add は TS_BATCH 回に一度になる。
+// COROUTINES では worker 内で並行するトランザクションごとにスロットを持つ
+// (slot = thread_id*TS_SLOTS + i)。
 class TimeStampGenerator {
-    std::atomic<int> global_ts=1;
-    std::list<int> ts_list;
-    std::mutex mtx;
-    std::atomic<int> gc_count_=0;
+    struct alignas(64) ActiveSlot {
+        std::atomic<int> ts{0};  // 0: no active transaction and no unused timestamp
+        int next = 0;            // unused timestamps of the batch: [next,end)
+        int end = 0;
+    };
+    alignas(64) std::atomic<int> global_ts{1};
+    ActiveSlot active[NUM_THREADS*TS_SLOTS];
 public:
+    int get_timestamp(int slot) {
+        ActiveSlot &a = active[slot];
+        if (a.next == a.end) {
+            // 採番より先に下限 (現在の global_ts) を公開しておくので、
+            // min_active_timestamp() は採番中のトランザクションを追い越さない。
+            a.ts.store(global_ts.load());
+            a.next = global_ts.fetch_add(TS_BATCH);
+            a.end = a.next + TS_BATCH;
+        }
+        int ts = a.next++;
+        a.ts.store(ts);
+        return ts;
+    }
 
-    int gc_count() {
-        return gc_count_.load();
+    // ISOLATION != SERIALIZABLE: write set を入れた後で取る commit timestamp
+    int get_commit_timestamp() {
+        return global_ts.fetch_add(1);
     }
 
-    int get_timestamp() {
-        int ts = global_ts.fetch_add(1);
-        {
-            std::lock_guard<std::mutex> lock(mtx);
-            ts_list.push_back(ts);
+    int min_active_timestamp() {
+        int ts = global_ts.load();
+        for (int i=0; i<NUM_THREADS*TS_SLOTS; i++) {
+            int t = active[i].ts.load();
+            if (t != 0 && t < ts) ts = t;
         }
         return ts;
     }
 
-    void transaction_end(int timestamp, DataItem *database) {
-        int ts0, ts1=0;
+    // 手元に残った timestamp は次のトランザクションが使うので、その最小値を
+    // 公開して watermark が追い越さないようにする。abort したトランザクションは
+    // 残りを捨てて新しいバッチから取り直し、古い timestamp で abort し続けないようにする。
+    void transaction_end(int slot, bool commit) {
+        ActiveSlot &a = active[slot];
+        if (!commit) a.next = a.end;
+        a.ts.store(a.next < a.end ? a.next : 0);
+    }
+
+    void thread_end(int slot) {
+        ActiveSlot &a = active[slot];
+        a.next = a.end;
+        a.ts.store(0);
+    }
+};
+
+
+// Incremental GC.
+// Workers put each item they add versions (or ReadRange entries) to into the
+// dirty queue once.  collect() takes items from the queue, collects them with
+// the current watermark and puts back the ones that still have versions newer
+// than the watermark.  Without GC threads, every worker collects GC_BATCH
+// items every GC_INTERVAL commits, so no transaction pays for a full sweep.
+class GarbageCollector {
+    DataItem *database;
+    TimeStampGenerator *tsg;
+    std::vector<std::atomic<bool>> dirty;
+    std::mutex mtx;
+    std::deque<int> queue;
+    alignas(64) std::atomic<int> gc_ts{0};  // watermark of the last collect()
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> thv;
+    GcStats stats[GC_THREADS > 0 ? GC_THREADS : 1] = {};
+
+    // 前回から watermark が 10 より進んでいれば、最大 max_items 個の item を GC する。
+    // 同じ watermark で複数のスレッドが GC しないよう gc_ts を CAS で進める。
+    void collect(size_t max_items, std::vector<int> &batch, GcStats *st) {
+        int ts0 = gc_ts.load();
+        int ts = tsg->min_active_timestamp();
+        if (ts-ts0 <= 10 || !gc_ts.compare_exchange_strong(ts0,ts)) return;
         {
             std::lock_guard<std::mutex> lock(mtx);
-            ts0 = ts_list.front();
-            if (ts0 == timestamp) {
-                ts_list.pop_front();
-                if (!ts_list.empty()) {
-                    ts1 = ts_list.front();
-                }
-            } else {
-                for (auto itr=ts_list.begin(); itr!=ts_list.end(); itr++) {
-                    if (*itr == timestamp) {
-                        ts_list.erase(itr);
-                        return;
-                    }
-                }
+            size_t n = std::min(max_items, queue.size());
+            batch.assign(queue.begin(), queue.begin()+n);
+            queue.erase(queue.begin(), queue.begin()+n);
+        }
+        if (batch.empty()) return;
+        DPRINTF("\nGC: ts=%d n=%ld\n",ts,batch.size());
+        Timer timer;
+        for (int key : batch) {
+            dirty[key].store(false);
+            if (database[key].gc(ts)) {
+                mark_dirty(key);
             }
         }
-        /*
-          ts_list = [10,11,12,13,14] => 10未満でGCできる
-          ↓ ts = 11,12 が終了         => ts != ts_list.front()
-          ts_list = [10, 13,14]      => 10が残っているのでGCできない
-          ↓ ts = 10 が終了            => ts == ts_list.front()
-          ts_list = [13,14]          => 13の前までGCできる
-         */
-        if (ts1>0 && ts1-ts0 > 10) {
-            gc_count_.fetch_add(1);
-            DPRINTF("\nGC: ts0=%d ts1=%d ts_list.size=%ld\n",ts0,ts1,ts_list.size());
-            for (int i=0; i<NUM_DATA; i++) {
-                database[i].gc(ts1);
+        double t = timer.get_time();
+        st->n_sweep++;
+        st->n_item += batch.size();
+        st->t_total += t;
+        if (t > st->t_max) st->t_max = t;
+    }
+
+    void run(int gc_id) {
+        std::vector<int> batch;
+
+        epoch.register_thread(NUM_THREADS+gc_id);
+        while (!stop.load()) {
+            batch.clear();
+            epoch.enter();
+            epoch.donate();
+            collect(NUM_DATA, batch, &stats[gc_id]);
+            epoch.exit();
+            if (batch.empty()) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
             }
         }
     }
+
+public:
+    static const int GC_INTERVAL = 16;
+    static const int GC_BATCH = 16;
+
+    GarbageCollector(DataItem *database, TimeStampGenerator *tsg)
+        : database(database), tsg(tsg), dirty(NUM_DATA) {
+        for (int i=0; i<NUM_DATA; i++) {
+            dirty[i].store(false);
+        }
+    }
+
+    void start() {
+        for (int i=0; i<GC_THREADS; i++) {
+            thv.emplace_back(&GarbageCollector::run, this, i);
+        }
+    }
+
+    void finish() {
+        stop.store(true);
+        for (auto& th : thv) th.join();
+    }
+
+    void mark_dirty(int key) {
+        if (dirty[key].load() || dirty[key].exchange(true)) return;
+        std::lock_guard<std::mutex> lock(mtx);
+        queue.push_back(key);
+    }
+
+    // called by a worker inside its epoch after each commit
+    void step(int n_commit, std::vector<int> &batch, GcStats *st) {
+        if (GC_THREADS > 0 || n_commit % GC_INTERVAL != 0) return;
+        batch.clear();
+        collect(GC_BATCH, batch, st);
+    }
+
+    void add_stats(GcStats *sum) {
+        for (int i=0; i<GC_THREADS; i++) {
+            sum->n_sweep += stats[i].n_sweep;
+            sum->n_item += stats[i].n_item;
+            sum->t_total += stats[i].t_total;
+            if (stats[i].t_max > sum->t_max) sum->t_max = stats[i].t_max;
+        }
+    }
 };
 
 
-class Timer {
-    struct timespec start_time;
-public:
-    Timer() {clock_gettime(CLOCK_MONOTONIC, &start_time);}
+#if COROUTINES
+// worker が順番に resume() するだけの最小限のコルーチン
+struct Task {
+    struct promise_type {
+        Task get_return_object() {
+            return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept {return {};}
+        std::suspend_always final_suspend() noexcept {return {};}
+        void return_void() {}
+        void unhandled_exception() {std::terminate();}
+    };
+    std::coroutine_handle<promise_type> handle;
+};
 
-    double get_time()
-    {
-        struct timespec t;
-        clock_gettime(CLOCK_MONOTONIC, &t);
-        return t.tv_sec - start_time.tv_sec + (t.tv_nsec - start_time.tv_nsec)/1e9;
+// p を prefetch して同じ worker の次のトランザクションに譲る
+struct Prefetch {
+    const void *p;
+    bool await_ready() const noexcept {
+        __builtin_prefetch(p);
+        return false;
     }
+    void await_suspend(std::coroutine_handle<>) const noexcept {}
+    void await_resume() const noexcept {}
 };
 
+#define TRANSACTIONS Task
+#define PREFETCH_YIELD(p) co_await Prefetch{p}
+#else
+#define TRANSACTIONS void
+#define PREFETCH_YIELD(p) {}
+#endif
 
-void worker(int thread_id, std::vector<std::vector<XACT>> *xact_vec,
-            DataItem *database, TimeStampGenerator *tsg, ThreadResult *result)
+#if PREFETCH
+// このトランザクションの item の最新バージョンと、次のトランザクションの item を
+// prefetch する。item は前のトランザクションの開始時に prefetch してあるので、
+// newest() の load はキャッシュに当たる (最初のトランザクションは item から)。
+static void prefetch_stage(DataItem *database, const XACT *cur, const XACT *next, bool first)
 {
-    Timer timer;
-    double t_elap;
-    int n_abort=0;
+    if (first) {
+        for (int i=0; i<TX_LEN; i++) {
+            __builtin_prefetch(database[cur[i].key].head());
+        }
+    }
+    for (int i=0; i<TX_LEN; i++) {
+        __builtin_prefetch(database[cur[i].key].newest());
+    }
+    if (next != NULL) {
+        for (int i=0; i<TX_LEN; i++) {
+            __builtin_prefetch(database[next[i].key].head());
+        }
+    }
+}
+#endif
+
+#if HISTORY
+// worker ごとの history バッファ (COROUTINES では worker 内で共有)
+HIST_BUF hist_buf[NUM_THREADS];
+#endif
+
+// worker の統計と GC の作業領域 (COROUTINES では worker 内のトランザクションで共有)
+typedef struct _WorkerState {
+    XACT *xacts;                 // TX_LEN ops per transaction
+    DataItem *database;
+    TimeStampGenerator *tsg;
+    GarbageCollector *gc;
+    int n_abort;
+    int n_commit;
+    long ts_cycles;
+    GcStats gc_stats;
+    std::vector<int> gc_batch;
+    PHASES phases;
+    CONFLICTS conflicts;
+} WorkerState;
+
+// repeat = first, first+step, ... のトランザクションを実行する。
+// COROUTINES では read の前に item と最新バージョンを prefetch して yield する。
+// 他のトランザクションは同じスレッドで動くので、pending のバージョンを持った
+// まま yield しない (読む側が committed() で待ち続ける)。epoch には worker が
+// resume の間だけ入るので、yield をまたいでバージョンへのポインタも持たない。
+TRANSACTIONS run_transactions(WorkerState *ws, int slot, int first, int step)
+{
+    DataItem *database = ws->database;
+    TimeStampGenerator *tsg = ws->tsg;
+    GarbageCollector *gc = ws->gc;
+#if DEFERRED_WRITE
+    std::vector<VersionValue*> installed;
+#endif
+#if COROUTINES
+    std::minstd_rand rnd(slot+1);
+#endif
 
-    for (int repeat=0; repeat < N_REPEAT; repeat++) {
-        std::vector<XACT> xact = (*xact_vec)[repeat];
+    for (int repeat=first; repeat < N_REPEAT; repeat += step) {
+        std::vector<XACT> xact(ws->xacts + repeat*TX_LEN, ws->xacts + (repeat+1)*TX_LEN);
+#if PREFETCH
+        prefetch_stage(database, &ws->xacts[repeat*TX_LEN],
+                       (repeat+step < N_REPEAT) ? &ws->xacts[(repeat+step)*TX_LEN] : NULL,
+                       repeat == first);
+#endif
+#if COROUTINES
+        int n_retry = 0;
+#endif
     retry:
-        int ts = tsg->get_timestamp();
+#if !COROUTINES
+        epoch.enter();
+#endif
+        long t0 = __rdtsc();
+        int ts = tsg->get_timestamp(slot);
+        ws->ts_cycles += __rdtsc() - t0;
         std::unordered_map<int,Value> values;
+#if DEFERRED_WRITE
+        std::unordered_map<int,Value> writes;
+#endif
+        int conflict_key = -1, conflict_with = -1;  // abort した write
+        PHASE(&ws->phases, PH_READ);
+#if HISTORY
+        std::vector<std::pair<int,int>> hist_reads;  // key, version
+        int hist_version = ts;                       // version of the writes
+#endif
 
         // Read phase
         for (int i=0; i<TX_LEN; i++) {
@@ -294,80 +1082,345 @@ void worker(int thread_id, std::vector<std::vector<XACT>> *xact_vec,
             int type = xact[i].type;
             Value v;
             if (type == READ) {
+#if DEFERRED_WRITE
+                // 自分の書き込みはまだ database にないので write set から読む
+                auto w = writes.find(key);
+                if (w != writes.end()) {
+                    values[key] = v = w->second + 1;
+                    continue;
+                }
+#endif
+                PREFETCH_YIELD(database[key].head());
+                PREFETCH_YIELD(database[key].newest());
+#if HISTORY
+                int ver;
+                values[key] = v = database[key].read(ts, &ver) + 1;
+                hist_reads.push_back({key, ver});
+#else
                 values[key] = v = database[key].read(ts) + 1;
+#endif
+                if (!VERSION_RTS) gc->mark_dirty(key);
             }
             if (type == WRITE) {
                 auto itr = values.find(key);
                 v = (itr == values.end()) ? 0 : values[key];
-                bool success = database[key].write(ts, v);
+#if DEFERRED_WRITE
+                writes[key] = v;
+#else
+                PREFETCH_YIELD(database[key].head());
+                PHASE(&ws->phases, PH_WRITE);
+                bool success = database[key].write(ts, v, NULL, &conflict_with);
+                gc->mark_dirty(key);
                 if (!success) {
-                    n_abort++;
-                    tsg->transaction_end(ts,database);
-                    std::this_thread::sleep_for(std::chrono::nanoseconds(1));
-                    goto retry;
+                    conflict_key = key;
+                    goto abort;
                 }
+                PHASE(&ws->phases, PH_READ);
+#endif
+            }
+        }
+#if DEFERRED_WRITE
+#if COROUTINES
+        // write set をまとめて prefetch してから一度だけ yield する
+        for (auto &w : writes) {
+            __builtin_prefetch(database[w.first].head());
+        }
+        co_await std::suspend_always{};
+#endif
+        // Commit: write set を pending で加え、全部入ったら committed にする
+        PHASE(&ws->phases, PH_WRITE);
+        installed.clear();
+#if ISOLATION == SERIALIZABLE
+        for (auto &w : writes) {
+            VersionValue *x = NULL;
+            bool success = database[w.first].write(ts, w.second, &x, &conflict_with);
+#else
+        std::vector<std::pair<int,Value>> sorted_writes(writes.begin(), writes.end());
+        std::sort(sorted_writes.begin(), sorted_writes.end());
+        for (auto &w : sorted_writes) {
+            VersionValue *x = NULL;
+            bool success = database[w.first].install(ts, w.second, &x, &conflict_with);
+#endif
+            gc->mark_dirty(w.first);
+            if (!success) {
+                conflict_key = w.first;
+                for (auto y : installed) {
+#if ISOLATION == SERIALIZABLE
+                    y->status.store(ABORTED);
+#else
+                    DataItem::abort_version(y);
+#endif
+                }
+                goto abort;
+            }
+            installed.push_back(x);
+        }
+#if ISOLATION == SERIALIZABLE
+        for (auto y : installed) {
+            y->status.store(COMMITTED);
+        }
+#else
+        // 全部入れてから取るので、これ以上の timestamp で読むトランザクションは
+        // 必ず pending のバージョンを見て commit を待つ
+        if (!installed.empty()) {
+            int commit_ts = tsg->get_commit_timestamp();
+            for (auto y : installed) {
+                DataItem::commit_version(y, commit_ts);
+            }
+#if HISTORY
+            hist_version = commit_ts;
+#endif
+        }
+#endif
+#endif
+#if HISTORY
+        {
+            HIST_BUF *h = &hist_buf[slot / TS_SLOTS];
+            std::vector<int> wkeys;
+            for (int i=0; i<TX_LEN; i++) {
+                if (xact[i].type == WRITE) wkeys.push_back(xact[i].key);
             }
+            std::sort(wkeys.begin(), wkeys.end());
+            wkeys.erase(std::unique(wkeys.begin(), wkeys.end()), wkeys.end());
+            hist_begin(h, ts);
+            for (auto &r : hist_reads) hist_read(h, r.first, r.second);
+            for (int key : wkeys) hist_write(h, key, hist_version);
+            hist_commit(h);
         }
-        tsg->transaction_end(ts,database);
+#endif
+        tsg->transaction_end(slot,true);
+        ws->n_commit++;
+        PHASE(&ws->phases, PH_GC);
+        gc->step(ws->n_commit, ws->gc_batch, &ws->gc_stats);
+        PHASE(&ws->phases, PH_OTHER);
+#if !COROUTINES
+        epoch.exit();
+#endif
+        continue;
+
+    abort:
+        PHASE(&ws->phases, PH_BACKOFF);
+        // SERIALIZABLE: 後の読み込みより古い write、SNAPSHOT: 後に commit されたバージョン
+        conflict_add(&ws->conflicts, (ISOLATION == SERIALIZABLE) ? CF_LATE_WRITE : CF_SNAPSHOT,
+                     conflict_key, conflict_with);
+        ws->n_abort++;
+        tsg->transaction_end(slot,false);
+#if COROUTINES
+        // 同じ worker のトランザクションは決まった順に進むので、すぐ再実行すると
+        // 互いの読み込みで abort し合い続けることがある。ランダムな回数だけ譲る。
+        n_retry++;
+        for (int i = rnd() % (1 << std::min(n_retry,10)); i >= 0; i--) {
+            co_await std::suspend_always{};
+        }
+#else
+        epoch.exit();
+        std::this_thread::sleep_for(std::chrono::nanoseconds(1));
+#endif
+        goto retry;
+    }
+    tsg->thread_end(slot);
+}
+
+
+void worker(int thread_id, XACT *xacts,
+            DataItem *database, TimeStampGenerator *tsg, GarbageCollector *gc,
+            std::atomic<int> *n_running, ThreadResult *result)
+{
+    Timer timer;
+    double t_elap;
+    WorkerState ws = {xacts, database, tsg, gc, 0, 0, 0, {}, {}, {}, {}};
+    phase_init(&ws.phases);
+    conflict_init(&ws.conflicts);
+
+    epoch.register_thread(thread_id);
+#if HISTORY
+    hist_init(&hist_buf[thread_id], thread_id);
+#endif
+
+#if COROUTINES
+    // COROUTINES 個のトランザクションを終わるまで順番に resume する
+    std::vector<std::coroutine_handle<Task::promise_type>> tasks;
+    for (int i=0; i<COROUTINES; i++) {
+        tasks.push_back(run_transactions(&ws, thread_id*TS_SLOTS+i, i, COROUTINES).handle);
     }
+    for (size_t n_done=0; n_done < tasks.size(); ) {
+        n_done = 0;
+        for (auto h : tasks) {
+            if (h.done()) {
+                n_done++;
+                continue;
+            }
+            epoch.enter();
+            h.resume();
+            epoch.exit();
+        }
+    }
+    for (auto h : tasks) {
+        h.destroy();
+    }
+#else
+    run_transactions(&ws, thread_id, 0, 1);
+#endif
     result->t_elap = t_elap = timer.get_time();
-    result->n_abort = n_abort;
+#if HISTORY
+    hist_finish(&hist_buf[thread_id]);
+#endif
+    result->n_abort = ws.n_abort;
+    result->n_commit = N_REPEAT;
+    result->ts_cycles = ws.ts_cycles;
+    result->gc = ws.gc_stats;
     printf("thread%d: throughput=%f[tpx] time=%f[s] n_abort=%d abort_ratio=%f\n",
-           thread_id,N_REPEAT/t_elap,t_elap,n_abort,n_abort*1.0/N_REPEAT);
+           thread_id,N_REPEAT/t_elap,t_elap,ws.n_abort,ws.n_abort*1.0/N_REPEAT);
+    phase_report(&ws.phases, thread_id, N_REPEAT);
+    conflict_report(&ws.conflicts, thread_id);
+    n_running->fetch_sub(1);
 }
 
 
-int main(){
+// 古い timestamp のまま全 item を LONG_READ_PASSES 回読む読み込み専用トランザクションを、
+// 短いトランザクションの worker が終わるまで繰り返す。
+void long_reader(int thread_id, DataItem *database, TimeStampGenerator *tsg,
+                 std::atomic<int> *n_running, ThreadResult *result)
+{
+    Timer timer;
+    int n_commit=0;
+    double t_max=0;
+    long sum=0;
+
+    epoch.register_thread(thread_id);
+    while (n_running->load() > 0) {
+        double t0 = timer.get_time();
+        epoch.enter();
+        int ts = tsg->get_timestamp(thread_id*TS_SLOTS);
+        for (int pass=0; pass<LONG_READ_PASSES; pass++) {
+            for (int key=0; key<NUM_DATA; key++) {
+                sum += database[key].read(ts);
+            }
+        }
+        tsg->transaction_end(thread_id*TS_SLOTS,true);
+        epoch.exit();
+        double t = timer.get_time() - t0;
+        if (t > t_max) t_max = t;
+        n_commit++;
+    }
+    tsg->thread_end(thread_id*TS_SLOTS);
+    result->t_elap = timer.get_time();
+    result->n_abort = 0;
+    result->n_commit = n_commit;
+    result->ts_cycles = 0;
+    result->gc = GcStats{};
+    printf("thread%d: long_read n=%d latency=%f[s] max=%f[s] sum=%ld\n",
+           thread_id,n_commit,n_commit ? result->t_elap/n_commit : 0,t_max,sum);
+}
+
+
+int main(int argc, char *argv[]){
     int sum;
-    std::vector<std::vector<std::vector<XACT>>>
-        xact(NUM_THREADS,std::vector<std::vector<XACT>>(N_REPEAT,std::vector<XACT>(TX_LEN)));
+    std::vector<std::vector<XACT>> xact;
+    XACT *thread_xact[NUM_THREADS];
     std::mt19937 mt;
     std::uniform_int_distribution<> rand_type(0,1);
     std::uniform_int_distribution<> rand_key(0,NUM_DATA-1);
 
     // Create Transaction
     sum = 0;
-    for(int i=0; i<NUM_THREADS; i++){
-        DPRINTF("thread%d:",i);
-        for(int j=0; j<N_REPEAT; j++){
-            for (int k=0; k<TX_LEN; k++) {
-                XACT &x = xact[i][j][k];
-                x.type = rand_type(mt) ? READ : WRITE;
-                x.key = rand_key(mt);
-                DPRINTF("%s%d",(xact[i][j][k].type==READ) ? "r":"w",xact[i][j][k].key);
-                if (xact[i][j][k].type==READ) {
-                    sum += 1;
+    if (argc > 1) {
+        // replay the trace argv[1] instead of generating the transactions
+        const TRACE_HEADER *h = trace_open(argv[1], NUM_THREADS, TX_LEN, N_REPEAT, NUM_DATA);
+        for (int i=0; i<NUM_THREADS; i++) {
+            thread_xact[i] = TRACE_XACT(h, i);
+        }
+        sum = trace_n_read(h, NUM_THREADS, N_REPEAT);
+    } else {
+        xact.assign(NUM_THREADS, std::vector<XACT>(N_REPEAT*TX_LEN));
+        for(int i=0; i<NUM_THREADS; i++){
+            DPRINTF("thread%d:",i);
+            for(int j=0; j<N_REPEAT; j++){
+                for (int k=0; k<TX_LEN; k++) {
+                    XACT &x = xact[i][j*TX_LEN+k];
+                    x.type = rand_type(mt) ? READ : WRITE;
+                    x.key = rand_key(mt);
+                    DPRINTF("%s%d",(x.type==READ) ? "r":"w",x.key);
+                    if (x.type==READ) {
+                        sum += 1;
+                    }
                 }
+                DPRINTF(" ");
             }
-            DPRINTF(" ");
+            DPRINTF("\n");
+            thread_xact[i] = xact[i].data();
         }
-        DPRINTF("\n");
     }
 
-    DataItem database[NUM_DATA];
+    // NUM_DATA may be larger than the stack
+    std::vector<DataItem> database_vec(NUM_DATA);
+    DataItem *database = database_vec.data();
     TimeStampGenerator tsg;
+    GarbageCollector gc(database, &tsg);
 
+#if HISTORY
+    hist_open();
+#endif
+    gc.start();
     std::vector<std::thread> thv;
     ThreadResult result[NUM_THREADS];
-    for (size_t i = 0; i < NUM_THREADS; ++i) {
-        thv.emplace_back(worker, i, &xact[i], database, &tsg, &result[i]);
+    std::atomic<int> n_running{NUM_THREADS-LONG_READERS};
+    for (int i = 0; i < LONG_READERS; ++i) {
+        thv.emplace_back(long_reader, i, database, &tsg, &n_running, &result[i]);
+    }
+    for (int i = LONG_READERS; i < NUM_THREADS; ++i) {
+        thv.emplace_back(worker, i, thread_xact[i], database, &tsg, &gc, &n_running, &result[i]);
     }
 
     for (auto& th : thv) th.join();
+    gc.finish();
+#if HISTORY
+    hist_close();
+    printf("history: %s\n", HISTORY_FILE);
+#endif
 
     std::cout << std::endl;
-    for (int i=0; i<NUM_DATA; i++) {
+    for (int i=0; i<NUM_DATA && i<50; i++) {
         printf("data:%d\n",i);
         database[i].print();
     }
     int n_abort=0;
+    int n_commit=0;
     double t_elap=0;
-    for (size_t i = 0; i < NUM_THREADS; ++i) {
+    long ts_cycles=0;
+    GcStats gc_stats = {};
+    int n_long=0;
+    double t_long=0;
+    for (int i = 0; i < LONG_READERS; ++i) {
+        n_long += result[i].n_commit;
+        t_long += result[i].t_elap;
+    }
+    for (int i = LONG_READERS; i < NUM_THREADS; ++i) {
+        n_commit += result[i].n_commit;
         t_elap += result[i].t_elap;
         n_abort += result[i].n_abort;
+        ts_cycles += result[i].ts_cycles;
+        gc_stats.n_sweep += result[i].gc.n_sweep;
+        gc_stats.n_item += result[i].gc.n_item;
+        gc_stats.t_total += result[i].gc.t_total;
+        if (result[i].gc.t_max > gc_stats.t_max) gc_stats.t_max = result[i].gc.t_max;
+    }
+    gc.add_stats(&gc_stats);
+    if (LONG_READERS > 0) {
+        printf("long_read: readers=%d passes=%d n=%d avg_latency=%f[s]\n",
+               LONG_READERS,LONG_READ_PASSES,n_long,n_long ? t_long/n_long : 0);
     }
+    phase_report_total((long)N_REPEAT*(NUM_THREADS-LONG_READERS));
+    conflict_report_total();
+    printf("isolation: %s\n", ISOLATION == SNAPSHOT ? "snapshot" :
+           ISOLATION == READ_COMMITTED ? "read committed" : "serializable");
+    printf("timestamp(batch=%d): threads=%d cost=%f[cycles/attempt]\n",
+           TS_BATCH,NUM_THREADS,1.0*ts_cycles/(n_commit+n_abort));
+    printf("gc(%s): n_sweep=%d n_item=%ld time=%f max_pause=%f\n",
+           GC_THREADS ? "background" : "worker",gc_stats.n_sweep,gc_stats.n_item,
+           gc_stats.t_total,gc_stats.t_max);
     printf("throughput=%f[tpx] total_time=%f n_abort=%d abort_ratio=%f gc_count=%d\n",
-           N_TRANSACTION/t_elap*NUM_THREADS,t_elap,n_abort,1.0*n_abort/N_TRANSACTION,tsg.gc_count());
+           n_commit/t_elap*(NUM_THREADS-LONG_READERS),t_elap,n_abort,1.0*n_abort/n_commit,gc_stats.n_sweep);
 
     return 0;
 }
@@ -3,16 +3,65 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
+#include "../trace/trace.h"
+#include "../conflict/conflict.h"
 
 #define FORWARD_ALGORITHM 0
 #define SECOND_ALGORITHM 0
 #define DEBUG 0
 #define ABORT_USLEEP 1
 
+// 1: when the backward validation in the critical section fails, re-read the
+//    keys written by the conflicting transactions and recompute their values
+//    instead of aborting (backward validation)
+#ifndef REPAIR
+#define REPAIR 0
+#endif
+
+// 1: a key that is read and written is updated by a commutative delta
+//    applied in the write phase; it is not read, so it is not in the read set
+//    and concurrent delta updates of the same key don't abort each other
+#ifndef DELTA
+#define DELTA 0
+#endif
+
+// delta operation: 0: add, 1: min, 2: max
+#ifndef DELTA_OP
+#define DELTA_OP 0
+#endif
+#if DELTA_OP == 1
+#define APPLY_DELTA(x,d) ((d) < (x) ? (d) : (x))
+#elif DELTA_OP == 2
+#define APPLY_DELTA(x,d) ((d) > (x) ? (d) : (x))
+#else
+#define APPLY_DELTA(x,d) ((x) + (d))
+#endif
+
+// 1: record the committed transactions to HISTORY_FILE for history/check
+//    (version: the transaction number of the writer)
+#ifndef HISTORY
+#define HISTORY 0
+#endif
+#if HISTORY
+#include "../history/history.h"
+#if FORWARD_ALGORITHM
+#error "HISTORY numbers the versions in the critical section; the forward algorithm writes outside it"
+#endif
+#endif
+
+// 1: cycles per phase (read, modify, lock, validate, write, backoff),
+// 2: also perf counters per phase (see phase/phase.h)
+#ifndef PHASE_STATS
+#define PHASE_STATS 0
+#endif
+#include "../phase/phase.h"
+
 #if DEBUG
 #define NUM_THREADS 4
 #define NUM_DATA 5
@@ -27,16 +76,24 @@
 
 typedef struct _DATA {
     int val;
+#if HISTORY
+    int version;    // written under the giant lock
+#endif
     //pthread_rwlock_t lock;
 } DATA;
 
-typedef enum {NONE=0, READ=1, WRITE=2} TYPE;
+typedef enum {NONE=0, READ=1, WRITE=2, DELTA_UPDATE=4} TYPE;
 
 typedef struct _XACT {
     int key;
     TYPE type;
 } XACT;
 
+typedef struct _THREAD_ARGS {
+    int   id;
+    XACT *xact;
+} THREAD_ARGS;
+
 typedef struct _TX {
     int *values;
     TYPE *types;
@@ -45,6 +102,7 @@ typedef struct _TX {
 DATA Database[NUM_DATA];
 pthread_t threads[NUM_THREADS];
 XACT xact[TX_LEN*N_REPEAT][NUM_THREADS];
+XACT *thread_xact[NUM_THREADS];
 TX tx_seq[N_REPEAT*NUM_THREADS];
 int tid_global=0;
 pthread_mutex_t giant_lock;
@@ -86,9 +144,10 @@ void delete_from_set(TX **a, int *n, TX *item)
 
 #define LOCK()                              \
     {                                       \
-        t = get_time();                     \
+        PHASE(&phases, PH_LOCK);            \
+        t = phase_now();                    \
         pthread_mutex_lock(&giant_lock);    \
-        tsum += get_time() - t;             \
+        tsum += phase_now() - t;            \
     }
 #define UNLOCK()                            \
     {                                       \
@@ -97,14 +156,25 @@ void delete_from_set(TX **a, int *n, TX *item)
 
 void *worker(void *arg)
 {
-    XACT *xact = (XACT*)arg;
+    XACT *xact = ((THREAD_ARGS*)arg)->xact;
+    int thread_id = ((THREAD_ARGS*)arg)->id;
     int tid_start, tid_end;
-    int t, tsum = 0;
+    uint64_t t, tsum = 0;
     int t_begin = get_time(), t_end;
     double t_elap, t_lock;
     TX tx;
     int n_abort=0;
+    int n_repair=0;
     int n_commit=0;
+    PHASES phases;
+    phase_init(&phases);
+    CONFLICTS conflicts;
+    conflict_init(&conflicts);
+#if HISTORY
+    HIST_BUF hist;
+    int version[NUM_DATA];
+    hist_init(&hist, thread_id);
+#endif
 #if FORWARD_ALGORITHM
         int n_act;
         TX *fin_act_tx[NUM_THREADS];
@@ -118,19 +188,42 @@ void *worker(void *arg)
             tx.types[k] = NONE;
         }
 
+#if !REPAIR || SECOND_ALGORITHM || FORWARD_ALGORITHM
     retry:
+#endif
+
+#if DELTA
+        // read-modify-write keys become delta updates
+        for (int i=0; i<TX_LEN; i++) {
+            tx.types[xact[i].key] |= xact[i].type;
+        }
+        for (int k=0; k<NUM_DATA; k++) {
+            if (tx.types[k] & DELTA_UPDATE || tx.types[k] == (READ|WRITE)) {
+                tx.types[k] = WRITE|DELTA_UPDATE;
+                tx.values[k] = 0;
+            }
+        }
+#endif
 
         // Read phase
+        PHASE(&phases, PH_READ);
         tid_start = tid_global;
         for (int i=0; i<TX_LEN; i++) {
             int k = xact[i].key;
+#if DELTA
+            if (tx.types[k] & DELTA_UPDATE) continue;
+#endif
             tx.types[k] |= xact[i].type;
             if (xact[i].type == READ) {
+#if HISTORY
+                version[k] = Database[k].version;
+#endif
                 tx.values[k] = Database[k].val;
             }
         }
 
         // modify
+        PHASE(&phases, PH_MODIFY);
         for (int i=0; i<TX_LEN; i++) {
             if (xact[i].type == READ) {
                 tx.values[xact[i].key] += 1;
@@ -138,6 +231,7 @@ void *worker(void *arg)
         }
 
         // Validation
+        PHASE(&phases, PH_VALIDATE);
 #if FORWARD_ALGORITHM
         /* 3rd algorithm
         tend = (
@@ -154,6 +248,7 @@ void *worker(void *arg)
         act_tx[act_tx_len] = &tx;
         act_tx_len++;
         UNLOCK();
+        PHASE(&phases, PH_VALIDATE);
 
         /*
         　for t from start tn + 1 to finish tn do
@@ -168,7 +263,9 @@ void *worker(void *arg)
                     LOCK();
                     delete_from_set(act_tx,&act_tx_len,&tx);
                     UNLOCK();
+                    conflict_add(&conflicts, CF_WRITESET, k, i);
                     n_abort += 1;
+                    PHASE(&phases, PH_BACKOFF);
                     usleep(ABORT_USLEEP);
                     goto retry;
                 }
@@ -187,7 +284,9 @@ void *worker(void *arg)
                     LOCK();
                     delete_from_set(act_tx,&act_tx_len,&tx);
                     UNLOCK();
+                    conflict_add(&conflicts, CF_WRITESET, k, -1);
                     n_abort += 1;
+                    PHASE(&phases, PH_BACKOFF);
                     usleep(ABORT_USLEEP);
                     goto retry;
                 }
@@ -214,7 +313,9 @@ void *worker(void *arg)
                 // writeset of tid intersects my readset
                 if (tx_seq[i].types[k] & WRITE && tx.types[k] & READ) {
                     // abort
+                    conflict_add(&conflicts, CF_WRITESET, k, i);
                     n_abort += 1;
+                    PHASE(&phases, PH_BACKOFF);
                     usleep(ABORT_USLEEP);
                     goto retry;
                 }
@@ -232,19 +333,53 @@ void *worker(void *arg)
         　　　then valid := false;
          */
         LOCK();
+        PHASE(&phases, PH_VALIDATE);
         tid_end = tid_global;
+#if REPAIR
+        // No one else can commit while we hold the giant lock, so the stale
+        // keys re-read here stay valid until our write phase.  A value
+        // depends only on the read of its own key, so only those are redone.
+        {
+            bool stale[NUM_DATA] = {false};
+            bool repaired = false;
+            for (int i = tid_start; i < tid_end; i++) {
+                for (int k=0; k<NUM_DATA; k++) {
+                    if (tx_seq[i].types[k] & WRITE && tx.types[k] & READ) {
+                        stale[k] = repaired = true;
+                    }
+                }
+            }
+            if (repaired) {
+                for (int k=0; k<NUM_DATA; k++) {
+                    if (stale[k]) tx.values[k] = Database[k].val;
+#if HISTORY
+                    if (stale[k]) version[k] = Database[k].version;
+#endif
+                }
+                for (int i=0; i<TX_LEN; i++) {
+                    if (xact[i].type == READ && stale[xact[i].key]) {
+                        tx.values[xact[i].key] += 1;
+                    }
+                }
+                n_repair += 1;
+            }
+        }
+#else
         for (int i = tid_start; i < tid_end; i++) {
             for (int k=0; k<NUM_DATA; k++) {
                 // writeset of tid intersects my readset
                 if (tx_seq[i].types[k] & WRITE && tx.types[k] & READ) {
                     // abort
                     UNLOCK();
+                    conflict_add(&conflicts, CF_WRITESET, k, i);
                     n_abort += 1;
+                    PHASE(&phases, PH_BACKOFF);
                     usleep(ABORT_USLEEP);
                     goto retry;
                 }
             }
         }
+#endif
 
 #endif // FORWARD_ALGORITHM
 
@@ -256,8 +391,27 @@ void *worker(void *arg)
 #endif
 
         // Write phase
+        PHASE(&phases, PH_WRITE);
+#if HISTORY
+        // no one else commits until we leave the giant lock
+        hist_begin(&hist, 0);
+#endif
         for (int k=0; k<NUM_DATA; k++) {
+#if HISTORY
+            if (tx.types[k] & READ) hist_read(&hist, k, version[k]);
+            // a delta update reads the version it is applied to
+            if (tx.types[k] & DELTA_UPDATE) hist_read(&hist, k, Database[k].version);
+            if (tx.types[k] & WRITE) {
+                Database[k].version = tid_global + 1;
+                hist_write(&hist, k, Database[k].version);
+            }
+#endif
             if (tx.types[k] & WRITE) {
+#if DELTA
+                if (tx.types[k] & DELTA_UPDATE) {
+                    Database[k].val = APPLY_DELTA(Database[k].val, tx.values[k]);
+                } else
+#endif
                 Database[k].val = tx.values[k];
             }
 #if DEBUG
@@ -291,58 +445,90 @@ void *worker(void *arg)
         tx_seq[tid_global] = tx;
         tid_global += 1;
         UNLOCK();
+#if HISTORY
+        hist_commit(&hist);
+#endif
         n_commit += 1;
 
         xact += TX_LEN;
     }
     t_end = get_time();
+#if HISTORY
+    hist_finish(&hist);
+#endif
     t_elap = (t_end-t_begin)*1e-6;
-    t_lock = tsum*1e-6;
-    printf("time: elap=%f lock=%f lock_ratio=%f n_abort=%d n_commit=%d\n",
-           t_elap,t_lock,t_lock/t_elap,n_abort,n_commit);
+    t_lock = tsum/phase_tsc_hz();
+    printf("time: elap=%f lock=%f lock_ratio=%f n_abort=%d n_repair=%d n_commit=%d\n",
+           t_elap,t_lock,t_lock/t_elap,n_abort,n_repair,n_commit);
+    phase_report(&phases, thread_id, n_commit);
+    conflict_report(&conflicts, thread_id);
 
     return NULL;
 }
 
 
-int main(){
+int main(int argc, char *argv[]){
     int i, j, sum;
+    THREAD_ARGS thread_args[NUM_THREADS];
 
     // Initialize Database
     pthread_mutex_init(&giant_lock, 0);
 
     // Create Transaction
     sum = 0;
-    for(i=0; i<NUM_THREADS; i++){
+    if (argc > 1) {
+        // replay the trace argv[1] instead of generating the transactions
+        const TRACE_HEADER *h = trace_open(argv[1], NUM_THREADS, TX_LEN, N_REPEAT, NUM_DATA);
+        for (i=0; i<NUM_THREADS; i++) {
+            thread_xact[i] = TRACE_XACT(h, i);
+        }
+        sum = trace_n_read(h, NUM_THREADS, N_REPEAT);
+    } else {
+        for(i=0; i<NUM_THREADS; i++){
 #if DEBUG
-        printf("thread%d:",i);
+            printf("thread%d:",i);
 #endif
-        for(j=0; j<TX_LEN*N_REPEAT; j++){
-            xact[j][i].type = (random()&1) ? READ : WRITE;
-            xact[j][i].key = (int)(random()/(1.0+RAND_MAX) * NUM_DATA);
+            for(j=0; j<TX_LEN*N_REPEAT; j++){
+                xact[j][i].type = (random()&1) ? READ : WRITE;
+                xact[j][i].key = (int)(random()/(1.0+RAND_MAX) * NUM_DATA);
 #if DEBUG
-            printf(" %c%d",(xact[j][i].type==READ) ? 'r':'w', xact[j][i].key);
+                printf(" %c%d",(xact[j][i].type==READ) ? 'r':'w', xact[j][i].key);
 #endif
-            if (xact[j][i].type==READ) {
-                sum += 1;
+                if (xact[j][i].type==READ) {
+                    sum += 1;
+                }
             }
-        }
 #if DEBUG
-        printf("\n");
+            printf("\n");
 #endif
+        }
+        for(i=0; i<NUM_THREADS; i++){
+            thread_xact[i] = xact[i];
+        }
     }
     printf("# of READ=%d\n",sum);
+#if HISTORY
+    hist_open();
+#endif
     init_time();
 
     // Start threads
     for(i=0; i<NUM_THREADS; i++) {
-        pthread_create(&threads[i], NULL, worker, &xact[i]);
+        thread_args[i].id = i;
+        thread_args[i].xact = thread_xact[i];
+        pthread_create(&threads[i], NULL, worker, &thread_args[i]);
     }
 
     // Join threads
     for(i=0; i<NUM_THREADS; i++) {
         pthread_join(threads[i], NULL);
     }
+    conflict_report_total();
+#if HISTORY
+    hist_close();
+    printf("history: %s\n", HISTORY_FILE);
+#endif
+    phase_report_total((long)N_REPEAT*NUM_THREADS);
 
     // Print result
     sum = 0;
@@ -0,0 +1,239 @@
+// Cycle accounting per transaction phase, shared by the engines (C and C++).
+//
+// A worker keeps a PHASES and marks where each phase starts:
+//   PHASE(&phases, PH_READ);  ...  PHASE(&phases, PH_VALIDATE);  ...
+// The cycles (rdtsc) since the previous mark are added to the phase that was
+// running, so each mark costs one rdtsc and no call when disabled.
+//
+// PHASE_STATS (set by the engine before the include, default 0)
+//   0: PHASE() is compiled out and phase_report() prints nothing
+//   1: cycles and entries per phase
+//   2: also instructions, cache misses and branch misses per phase from
+//      perf_event_open counters of the thread; a mark then reads them with
+//      one read() of the counter group, so use it for the counts, and 1 for
+//      the cycles
+//
+// phase_now() and phase_tsc_hz() also time the engines' lock calls.
+
+#ifndef PHASE_H
+#define PHASE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#ifndef PHASE_STATS
+#define PHASE_STATS 0
+#endif
+#if PHASE_STATS >= 2
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+enum {PH_OTHER=0, PH_READ, PH_MODIFY, PH_LOCK, PH_VALIDATE, PH_WRITE, PH_BACKOFF, PH_GC, N_PHASE};
+static const char *const phase_name[N_PHASE] =
+    {"other", "read", "modify", "lock", "validate", "write", "backoff", "gc"};
+
+#define N_COUNTER 3
+static const char *const counter_name[N_COUNTER] = {"instructions", "cache_misses", "branch_misses"};
+
+typedef struct _PHASES {
+    int cur;
+    uint64_t t_last;
+    uint64_t cycles[N_PHASE];
+    uint64_t n[N_PHASE];                  // entries
+    int fd;                               // counter group (leader), -1: none
+    int fds[N_COUNTER];                   // the group's counters, fds[0] == fd
+    uint64_t ctr_last[N_COUNTER];
+    uint64_t ctr[N_PHASE][N_COUNTER];
+} PHASES;
+
+static inline uint64_t phase_now(void)
+{
+    return __rdtsc();
+}
+
+static double phase_hz;
+static pthread_once_t phase_hz_once = PTHREAD_ONCE_INIT;
+
+static void phase_calibrate(void)
+{
+    struct timespec a, b;
+    double t;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    uint64_t c = phase_now();
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        t = (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec)*1e-9;
+    } while (t < 0.01);
+    phase_hz = (phase_now() - c) / t;
+}
+
+// rdtsc ticks per second
+static inline double phase_tsc_hz(void)
+{
+    pthread_once(&phase_hz_once, phase_calibrate);
+    return phase_hz;
+}
+
+#if PHASE_STATS
+#define PHASE(p, ph) phase_enter(p, ph)
+#else
+#define PHASE(p, ph) ((void)0)
+#endif
+
+#if PHASE_STATS >= 2
+static int phase_counter(uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = (group == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+static inline void phase_read_counters(PHASES *p, int ph)
+{
+#if PHASE_STATS >= 2
+    uint64_t buf[1 + N_COUNTER];
+    if (p->fd >= 0 && read(p->fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf)) {
+        for (int i=0; i<N_COUNTER; i++) {
+            p->ctr[ph][i] += buf[1+i] - p->ctr_last[i];
+            p->ctr_last[i] = buf[1+i];
+        }
+    }
+#else
+    (void)p;
+    (void)ph;
+#endif
+}
+
+// close the first n counters of the group
+static inline void phase_close(PHASES *p, int n)
+{
+    for (int i=0; i<n; i++) {
+        close(p->fds[i]);
+    }
+    p->fd = -1;
+}
+
+// at the start of the worker; the time until the first mark is "other"
+static inline void phase_init(PHASES *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->fd = -1;
+#if PHASE_STATS >= 2
+    static const uint64_t config[N_COUNTER] =
+        {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    p->fd = p->fds[0] = phase_counter(config[0], -1);
+    for (int i=1; i<N_COUNTER && p->fd >= 0; i++) {
+        p->fds[i] = phase_counter(config[i], p->fd);
+        if (p->fds[i] < 0) {
+            phase_close(p, i);
+        }
+    }
+    static int warned;
+    if (p->fd < 0) {
+        if (!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED)) {
+            perror("perf_event_open (phase counters off)");
+        }
+    } else {
+        ioctl(p->fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        phase_read_counters(p, PH_OTHER);
+        memset(p->ctr, 0, sizeof(p->ctr));
+    }
+#endif
+    p->t_last = phase_now();
+}
+
+static inline void phase_enter(PHASES *p, int ph)
+{
+    uint64_t now = phase_now();
+    p->cycles[p->cur] += now - p->t_last;
+    p->t_last = now;
+    phase_read_counters(p, p->cur);
+    p->cur = ph;
+    p->n[ph]++;
+}
+
+#if PHASE_STATS
+static PHASES phase_sum;
+static int phase_sum_counters;
+static pthread_mutex_t phase_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static inline void phase_print(const PHASES *p, const char *who, long n_tx, int counters)
+{
+    uint64_t total = 0;
+    for (int i=0; i<N_PHASE; i++) {
+        total += p->cycles[i];
+    }
+    if (n_tx <= 0) n_tx = 1;
+    printf("%s: phase[cycles/tx]:", who);
+    for (int i=0; i<N_PHASE; i++) {
+        if (p->n[i] == 0 && p->cycles[i] == 0) continue;
+        printf(" %s=%.0f(%.1f%%)", phase_name[i], 1.0*p->cycles[i]/n_tx,
+               total ? 100.0*p->cycles[i]/total : 0);
+    }
+    printf("\n");
+    if (!counters) return;
+    for (int i=0; i<N_PHASE; i++) {
+        if (p->n[i] == 0) continue;
+        printf("%s: phase %s[/tx]:", who, phase_name[i]);
+        for (int j=0; j<N_COUNTER; j++) {
+            printf(" %s=%.1f", counter_name[j], 1.0*p->ctr[i][j]/n_tx);
+        }
+        printf("\n");
+    }
+}
+
+// at the end of the worker: close the phase that is running, print the
+// thread's phases per committed transaction and add them to the total
+static inline void phase_report(PHASES *p, int thread, long n_tx)
+{
+#if PHASE_STATS
+    char who[16];
+    phase_enter(p, PH_OTHER);
+    snprintf(who, sizeof(who), "%d", thread);
+    pthread_mutex_lock(&phase_lock);
+    phase_print(p, who, n_tx, p->fd >= 0);
+    for (int i=0; i<N_PHASE; i++) {
+        phase_sum.cycles[i] += p->cycles[i];
+        phase_sum.n[i] += p->n[i];
+        for (int j=0; j<N_COUNTER; j++) {
+            phase_sum.ctr[i][j] += p->ctr[i][j];
+        }
+    }
+    if (p->fd >= 0) {
+        phase_sum_counters = 1;
+        phase_close(p, N_COUNTER);
+    }
+    pthread_mutex_unlock(&phase_lock);
+#else
+    (void)p;
+    (void)thread;
+    (void)n_tx;
+#endif
+}
+
+// in main after the workers: the phases of all threads per committed transaction
+static inline void phase_report_total(long n_tx)
+{
+#if PHASE_STATS
+    phase_print(&phase_sum, "total", n_tx, phase_sum_counters);
+#else
+    (void)n_tx;
+#endif
+}
+
+#endif // PHASE_H
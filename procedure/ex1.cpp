@@ -0,0 +1,162 @@
+/* g++ ex1.cpp -o ex1 -g -O3 -std=c++17 -W -Wall -lpthread  */
+
+// The workload of twopl/ex1.c, occ/ex1.c and silo/ex2.c written once as a
+// stored procedure and run on every engine of this directory.
+// HISTORY=1: the committed transactions of each engine are recorded to
+// history_<engine>.bin for history/check.
+
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "procedure.hpp"
+#include "twopl.hpp"
+#include "occ.hpp"
+#include "silo.hpp"
+#include "mvto.hpp"
+#include "../trace/trace.h"
+
+#define DEBUG 0
+
+#if DEBUG
+#define NUM_THREADS 4
+#define NUM_DATA 5
+#define TX_LEN 5
+#define N_REPEAT (12/NUM_THREADS)
+#else
+#define NUM_THREADS 4
+#define NUM_DATA 10
+#define TX_LEN 30
+#define N_REPEAT (400000/NUM_THREADS)
+#endif
+#define N_SPARSE 1000
+
+using namespace procedure;
+
+typedef enum {NONE=0, READ=1, WRITE=2} TYPE;
+
+typedef struct _XACT {
+    int key;
+    TYPE type;
+} XACT;
+
+// Each key read by the transaction is incremented once per READ, and each
+// key written gets that value (0 if it was not read), as in the C engines.
+template <class Txn>
+void increment(Txn &tx, const XACT *xact)
+{
+    int type[NUM_DATA] = {};
+    int n_read[NUM_DATA] = {};
+
+    for (int i=0; i<TX_LEN; i++) {
+        type[xact[i].key] |= xact[i].type;
+        if (xact[i].type == READ) n_read[xact[i].key]++;
+    }
+    for (Key k=0; k<NUM_DATA; k++) {
+        Value v = (type[k] & READ) ? tx.read(k) + n_read[k] : 0;
+        if (type[k] & WRITE) tx.write(k, v);
+    }
+}
+
+template <class Txn>
+void load(Txn &tx)
+{
+    for (Key k=0; k<NUM_DATA; k++) {
+        tx.insert(k, 0);
+    }
+}
+
+template <class Txn>
+void sum_all(Txn &tx, long *sum)
+{
+    *sum = 0;
+    tx.scan(0, NUM_DATA, [sum](Key, Value v) {*sum += v;});
+}
+
+#if PROCEDURE_INDEX
+// the i-th sparse 64-bit key of thread t (HashIndex only)
+static Key sparse_key(int t, int i)
+{
+    return (Key)(t*N_SPARSE + i + 1) * 0x9e3779b97f4a7c15ULL;
+}
+#endif
+
+template <class Engine>
+void bench(const std::vector<XACT*> &xact)
+{
+    typename Engine::Database db(NUM_DATA, NUM_THREADS);
+    long sum = 0;
+
+#if HISTORY
+    char path[32];
+    snprintf(path, sizeof(path), "history_%s.bin", Engine::name);
+    history_open(path, NUM_THREADS);
+#endif
+    run<Engine>(db, 1, 1, [](typename Engine::Txn &tx, int, int) {load(tx);});
+    Stats st = run<Engine>(db, NUM_THREADS, N_REPEAT,
+                           [&xact](typename Engine::Txn &tx, int t, int i) {
+                               increment(tx, &xact[t][i*TX_LEN]);
+                           });
+    run<Engine>(db, 1, 1, [&sum](typename Engine::Txn &tx, int, int) {sum_all(tx, &sum);});
+    printf("%-5s: throughput=%f[tpx] time=%f n_abort=%ld abort_ratio=%f sum=%ld\n",
+           Engine::name, st.n_commit/st.t_elap, st.t_elap, st.n_abort,
+           1.0*st.n_abort/st.n_commit, sum);
+
+#if PROCEDURE_INDEX
+    // insert sparse keys, then delete every other one
+    long n_present = 0;
+    run<Engine>(db, NUM_THREADS, N_SPARSE, [](typename Engine::Txn &tx, int t, int i) {
+        tx.insert(sparse_key(t, i), i);
+    });
+    run<Engine>(db, NUM_THREADS, N_SPARSE/2, [](typename Engine::Txn &tx, int t, int i) {
+        tx.remove(sparse_key(t, 2*i));
+    });
+    run<Engine>(db, 1, 1, [&n_present](typename Engine::Txn &tx, int, int) {
+        n_present = 0;
+        for (int t=0; t<NUM_THREADS; t++) {
+            for (int i=0; i<N_SPARSE; i++) {
+                if (tx.read(sparse_key(t, i)) != ABSENT) n_present++;
+            }
+        }
+    });
+    printf("%-5s: sparse keys present=%ld expected=%d\n",
+           Engine::name, n_present, NUM_THREADS*N_SPARSE/2);
+#endif
+#if HISTORY
+    history_close();
+    printf("%-5s: history: %s\n", Engine::name, path);
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::vector<XACT>> xact;
+    std::vector<XACT*> thread_xact(NUM_THREADS);
+    std::mt19937 mt;
+    std::uniform_int_distribution<> rand_type(0,1);
+    std::uniform_int_distribution<> rand_key(0,NUM_DATA-1);
+
+    // Create Transaction
+    if (argc > 1) {
+        // replay the trace argv[1] instead of generating the transactions
+        const TRACE_HEADER *h = trace_open(argv[1], NUM_THREADS, TX_LEN, N_REPEAT, NUM_DATA);
+        for (int t=0; t<NUM_THREADS; t++) {
+            thread_xact[t] = TRACE_XACT(h, t);
+        }
+    } else {
+        xact.assign(NUM_THREADS, std::vector<XACT>(TX_LEN*N_REPEAT));
+        for (int t=0; t<NUM_THREADS; t++) {
+            for (auto &op : xact[t]) {
+                op.type = rand_type(mt) ? READ : WRITE;
+                op.key = rand_key(mt);
+            }
+            thread_xact[t] = xact[t].data();
+        }
+    }
+
+    bench<TwoPL>(thread_xact);
+    bench<OCC>(thread_xact);
+    bench<Silo>(thread_xact);
+    bench<MVTO>(thread_xact);
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+/* g++ ex2.cpp -o ex2 -g -O3 -std=c++17 -W -Wall -lpthread  */
+
+// Lookup cost of HashIndex against the direct array (DirectIndex), and
+// concurrent inserts of sparse 64-bit keys while the table grows.
+
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "index.hpp"
+
+#define NUM_THREADS 4
+#define N_LOOKUP 10000000
+#define N_INSERT (1000000/NUM_THREADS)
+
+using namespace procedure;
+
+struct Record {
+    std::atomic<Value> value{ABSENT};
+};
+
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ns per get() of keys[i % n]
+template <class Index>
+double lookup(Index &index, const std::vector<Key> &keys)
+{
+    long sum = 0;
+    double t = now();
+    for (long i=0; i<N_LOOKUP; i++) {
+        sum += index.get(keys[i % keys.size()]).value.load(std::memory_order_relaxed);
+    }
+    t = now() - t;
+    if (sum == 1) printf("\n");  // keep the loop
+    return t / N_LOOKUP * 1e9;
+}
+
+void bench_lookup(long n_records)
+{
+    std::mt19937_64 mt(n_records);
+    std::vector<Key> dense(n_records), sparse(n_records), order(n_records);
+
+    for (long i=0; i<n_records; i++) {
+        dense[i] = i;
+        sparse[i] = mt();
+    }
+    // visit the records in random order
+    for (long i=0; i<n_records; i++) {
+        order[i] = mt() % n_records;
+    }
+    for (long i=0; i<n_records; i++) {
+        dense[i] = order[i];
+        sparse[i] = sparse[order[i]];
+    }
+
+    DirectIndex<Record> direct(n_records);
+    HashIndex<Record> hash_dense(n_records);
+    HashIndex<Record> hash_sparse(n_records);
+    for (long i=0; i<n_records; i++) {
+        direct.get(i).value = 0;
+        hash_dense.get(i).value = 0;
+        hash_sparse.get(sparse[i]).value = 0;
+    }
+    printf("n_records=%-8ld direct=%6.1f[ns] hash(dense)=%6.1f[ns] hash(sparse)=%6.1f[ns]\n",
+           n_records, lookup(direct, dense), lookup(hash_dense, dense),
+           lookup(hash_sparse, sparse));
+}
+
+// every thread inserts N_INSERT random keys into a table sized for 2
+void bench_insert()
+{
+    HashIndex<Record> index(2);
+    std::vector<std::thread> thv;
+    double t = now();
+
+    for (int i=0; i<NUM_THREADS; i++) {
+        thv.emplace_back([&index, i]() {
+            std::mt19937_64 mt(i);
+            for (int j=0; j<N_INSERT; j++) {
+                index.get(mt()).value = j;
+            }
+        });
+    }
+    for (auto &th : thv) {
+        th.join();
+    }
+    t = now() - t;
+
+    // every key is found with the value its thread stored last
+    long n_lost = 0;
+    for (int i=0; i<NUM_THREADS; i++) {
+        std::mt19937_64 mt(i);
+        for (int j=0; j<N_INSERT; j++) {
+            if (index.get(mt()).value != j) n_lost++;
+        }
+    }
+    printf("insert: %d threads %f[ns/insert] n_lost=%ld\n",
+           NUM_THREADS, t / (NUM_THREADS*N_INSERT) * 1e9, n_lost);
+}
+
+int main()
+{
+    bench_lookup(10);
+    bench_lookup(1000);
+    bench_lookup(100000);
+    bench_lookup(1000000);
+    bench_insert();
+    return 0;
+}
@@ -0,0 +1,171 @@
+/* g++ ex3.cpp -o ex3 -g -O3 -std=c++17 -W -Wall -lpthread  */
+
+// Long analytic scans next to short updates (HTAP).
+// UPDATERS threads run transfers between uniform random keys, first alone
+// and then while one more thread scans the whole table over and over.
+// Transfers keep the sum of all values, so a scan that commits with
+// another sum did not see a consistent state.  For each engine the report
+// gives the update throughput with and without the scans, the scan latency
+// and aborts, and for a multi-version engine the largest version count,
+// version chain and GC lag sampled during the run.
+
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "procedure.hpp"
+#include "twopl.hpp"
+#include "occ.hpp"
+#include "silo.hpp"
+#include "mvto.hpp"
+
+#define UPDATERS 3
+#define NUM_DATA 10000
+#define N_TRANSFER 5                   // transfers per update transaction
+#define N_UPDATE (100000/UPDATERS)
+#define INIT_VALUE 100
+#define LOAD_BATCH 100
+#define SAMPLE_MS 10
+
+using namespace procedure;
+
+typedef struct _TRANSFER {
+    Key from;
+    Key to;
+} TRANSFER;
+
+template <class Txn>
+void load(Txn &tx, int i)
+{
+    for (Key k=i*LOAD_BATCH; k<(Key)(i+1)*LOAD_BATCH; k++) {
+        tx.insert(k, INIT_VALUE);
+    }
+}
+
+template <class Txn>
+void transfer(Txn &tx, const TRANSFER *t)
+{
+    for (int i=0; i<N_TRANSFER; i++) {
+        Value a = tx.read(t[i].from);
+        Value b = tx.read(t[i].to);
+        tx.write(t[i].from, a-1);
+        tx.write(t[i].to, b+1);
+    }
+}
+
+template <class Txn>
+void sum_all(Txn &tx, long *sum)
+{
+    *sum = 0;
+    tx.scan(0, NUM_DATA, [sum](Key, Value v) {*sum += v;});
+}
+
+template <class D, class = void>
+struct has_version_stats : std::false_type {};
+template <class D>
+struct has_version_stats<D, std::void_t<decltype(std::declval<D&>().version_stats())>>
+    : std::true_type {};
+
+struct ScanStats {
+    int n_scan = 0;
+    int n_inconsistent = 0;
+    long n_abort = 0;
+    double t_total = 0;
+    double t_max = 0;
+};
+
+template <class Engine>
+Stats updates(typename Engine::Database &db, const std::vector<std::vector<TRANSFER>> &xfer)
+{
+    return run<Engine>(db, UPDATERS, N_UPDATE,
+                       [&xfer](typename Engine::Txn &tx, int t, int i) {
+                           transfer(tx, &xfer[t][i*N_TRANSFER]);
+                       });
+}
+
+template <class Engine>
+void bench(const std::vector<std::vector<TRANSFER>> &xfer)
+{
+    typedef typename Engine::Database Database;
+    typedef typename Engine::Txn Txn;
+
+    // updates alone
+    Stats alone;
+    {
+        Database db(NUM_DATA, UPDATERS+1);
+        run<Engine>(db, 1, NUM_DATA/LOAD_BATCH, [](Txn &tx, int, int i) {load(tx, i);});
+        alone = updates<Engine>(db, xfer);
+    }
+
+    // updates with a scanning thread (thread id UPDATERS)
+    Database db(NUM_DATA, UPDATERS+1);
+    run<Engine>(db, 1, NUM_DATA/LOAD_BATCH, [](Txn &tx, int, int i) {load(tx, i);});
+    std::atomic<bool> running{true};
+    Stats mixed;
+    ScanStats sc;
+    VersionStats vmax;
+
+    std::thread updater([&]() {
+        mixed = updates<Engine>(db, xfer);
+        running.store(false);
+    });
+    std::thread scanner([&]() {
+        while (running.load()) {
+            long sum = 0;
+            Stats st = run_thread<Engine>(db, UPDATERS, 1, [&sum](Txn &tx, int) {sum_all(tx, &sum);});
+            sc.n_scan++;
+            sc.n_abort += st.n_abort;
+            sc.t_total += st.t_elap;
+            if (st.t_elap > sc.t_max) sc.t_max = st.t_elap;
+            if (sum != (long)NUM_DATA*INIT_VALUE) sc.n_inconsistent++;
+        }
+    });
+    while (running.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(SAMPLE_MS));
+        if constexpr (has_version_stats<Database>::value) {
+            VersionStats v = db.version_stats();
+            vmax.n_versions = std::max(vmax.n_versions, v.n_versions);
+            vmax.max_chain = std::max(vmax.max_chain, v.max_chain);
+            vmax.gc_lag = std::max(vmax.gc_lag, v.gc_lag);
+        }
+    }
+    updater.join();
+    scanner.join();
+
+    double tp_alone = alone.n_commit/alone.t_elap;
+    double tp_mixed = mixed.n_commit/mixed.t_elap;
+    printf("%-5s: update alone=%.0f[tpx] abort_ratio=%f with scans=%.0f[tpx] abort_ratio=%f (%+.1f%%)\n",
+           Engine::name, tp_alone, 1.0*alone.n_abort/alone.n_commit,
+           tp_mixed, 1.0*mixed.n_abort/mixed.n_commit, (tp_mixed/tp_alone - 1)*100);
+    printf("%-5s: scan n=%d latency avg=%f max=%f[s] n_abort=%ld inconsistent=%d\n",
+           Engine::name, sc.n_scan, sc.n_scan ? sc.t_total/sc.n_scan : 0, sc.t_max,
+           sc.n_abort, sc.n_inconsistent);
+    if constexpr (has_version_stats<Database>::value) {
+        printf("%-5s: versions max=%ld (records=%d) chain max=%ld gc_lag max=%ld[ts]\n",
+               Engine::name, vmax.n_versions, NUM_DATA, vmax.max_chain, vmax.gc_lag);
+    }
+}
+
+int main()
+{
+    std::vector<std::vector<TRANSFER>> xfer(UPDATERS, std::vector<TRANSFER>(N_UPDATE*N_TRANSFER));
+    std::mt19937 mt;
+    std::uniform_int_distribution<Key> rand_key(0,NUM_DATA-1);
+    std::uniform_int_distribution<Key> rand_step(1,NUM_DATA-1);
+
+    // Create Transaction: from != to, so every transfer keeps the sum
+    for (auto &x : xfer) {
+        for (auto &t : x) {
+            t.from = rand_key(mt);
+            t.to = (t.from + rand_step(mt)) % NUM_DATA;
+        }
+    }
+
+    bench<TwoPL>(xfer);
+    bench<OCC>(xfer);
+    bench<Silo>(xfer);
+    bench<MVTO>(xfer);
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+// Record indexes.
+// An engine keeps its records in Index<Record> and finds them with
+// get(key), which creates an empty record (value ABSENT) the first time a
+// key is used.  Records are never removed: a deleted record is one whose
+// value is ABSENT again, so inserts and deletes are ordinary writes that go
+// through the engine's concurrency control, and a read of a missing key is
+// validated like any other read.
+//
+// PROCEDURE_INDEX 0: DirectIndex, the array Database[key] of the C engines
+//                    (keys in [0, n_records))
+//                 1: HashIndex, any 64-bit key (default)
+
+#ifndef PROCEDURE_INDEX_HPP
+#define PROCEDURE_INDEX_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "procedure.hpp"
+
+#ifndef PROCEDURE_INDEX
+#define PROCEDURE_INDEX 1
+#endif
+
+namespace procedure {
+
+template <class R>
+class DirectIndex {
+    std::vector<R> records;
+public:
+    explicit DirectIndex(std::size_t n_records) : records(n_records) {}
+
+    R &get(Key k) {return records[k];}
+
+    // f(key, record) for every record
+    template <class F>
+    void for_each(F f) {
+        for (std::size_t k=0; k<records.size(); k++) {
+            f(Key(k), records[k]);
+        }
+    }
+};
+
+// Lock-free split-ordered list (Shalev and Shavit).
+// All records are in one linked list sorted by bit-reversed hash, and the
+// bucket table points to dummy nodes inside the list.  Doubling the table
+// only makes the new buckets reachable; each is initialized on first use by
+// inserting its dummy after the dummy of the parent bucket, so nothing is
+// moved or locked while the table grows.  Nodes are never unlinked, so the
+// list needs no marked pointers and a failed CAS retries from the
+// predecessor.
+template <class R>
+class HashIndex {
+    struct Link {
+        std::uint64_t so_key;     // bit-reversed hash; odd: record, even: dummy
+        Key key;
+        std::atomic<Link*> next{nullptr};
+        Link(std::uint64_t so_key, Key key) : so_key(so_key), key(key) {}
+    };
+
+    struct Node : Link {
+        R rec;
+        Node(std::uint64_t so_key, Key key) : Link(so_key, key) {}
+    };
+
+    // segment s holds buckets [2^(s-1), 2^s); segment 0 holds bucket 0
+    static const int MAX_SEGMENTS = 48;
+    static const int LOAD_FACTOR = 2;
+
+    std::atomic<std::atomic<Link*>*> segments[MAX_SEGMENTS] = {};
+    std::atomic<std::uint64_t> n_buckets;
+    std::atomic<std::uint64_t> n_records{0};
+    Link head{0, 0};                  // dummy of bucket 0
+
+    // splitmix64 finalizer; a bijection, so distinct keys have distinct hashes
+    static std::uint64_t hash(Key k) {
+        std::uint64_t x = k;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    static std::uint64_t reverse(std::uint64_t x) {
+        x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+        x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+        x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+        return __builtin_bswap64(x);
+    }
+
+    std::atomic<Link*> &bucket(std::uint64_t b) {
+        int s = (b == 0) ? 0 : 64 - __builtin_clzll(b);
+        std::uint64_t base = (s == 0) ? 0 : 1ULL << (s-1);
+        std::atomic<Link*> *seg = segments[s].load(std::memory_order_acquire);
+        if (seg == nullptr) {
+            std::atomic<Link*> *n = new std::atomic<Link*>[(s == 0) ? 1 : base]();
+            if (segments[s].compare_exchange_strong(seg, n)) {
+                seg = n;
+            } else {
+                delete[] n;
+            }
+        }
+        return seg[b - base];
+    }
+
+    // the link (so_key, key) in the list after start; if it is missing,
+    // insert a new Node when make_record, a dummy Link otherwise
+    Link *find(Link *start, std::uint64_t so_key, Key key, bool make_record, bool *inserted) {
+        Link *n = nullptr;
+        Link *prev = start;
+        Link *cur = prev->next.load(std::memory_order_acquire);
+        for (;;) {
+            while (cur != nullptr &&
+                   (cur->so_key < so_key || (cur->so_key == so_key && cur->key < key))) {
+                prev = cur;
+                cur = cur->next.load(std::memory_order_acquire);
+            }
+            if (cur != nullptr && cur->so_key == so_key && cur->key == key) {
+                if (make_record) {
+                    delete static_cast<Node*>(n);
+                } else {
+                    delete n;
+                }
+                return cur;
+            }
+            if (n == nullptr) {
+                n = make_record ? new Node(so_key, key) : new Link(so_key, key);
+            }
+            n->next.store(cur, std::memory_order_relaxed);
+            if (prev->next.compare_exchange_weak(cur, n, std::memory_order_release,
+                                                 std::memory_order_acquire)) {
+                *inserted = true;
+                return n;
+            }
+        }
+    }
+
+    Link *get_bucket(std::uint64_t b) {
+        std::atomic<Link*> &slot = bucket(b);
+        Link *d = slot.load(std::memory_order_acquire);
+        if (d != nullptr) return d;
+        // split the parent bucket: b without its highest bit
+        Link *parent = get_bucket(b & ~(1ULL << (63 - __builtin_clzll(b))));
+        bool inserted = false;
+        d = find(parent, reverse(b), 0, false, &inserted);
+        slot.store(d, std::memory_order_release);
+        return d;
+    }
+
+public:
+    explicit HashIndex(std::size_t n_records) {
+        std::uint64_t n = 2;
+        while (n * LOAD_FACTOR < n_records) n *= 2;
+        n_buckets.store(n);
+        bucket(0).store(&head);
+    }
+
+    ~HashIndex() {
+        for (Link *x = head.next.load(), *y; x != nullptr; x = y) {
+            y = x->next.load();
+            if (x->so_key & 1) {
+                delete static_cast<Node*>(x);
+            } else {
+                delete x;
+            }
+        }
+        for (auto &s : segments) {
+            delete[] s.load();
+        }
+    }
+
+    HashIndex(const HashIndex&) = delete;
+    HashIndex &operator=(const HashIndex&) = delete;
+
+    R &get(Key k) {
+        std::uint64_t h = hash(k);
+        std::uint64_t size = n_buckets.load(std::memory_order_acquire);
+        Link *b = get_bucket(h & (size-1));
+        bool inserted = false;
+        // reverse(h | 1<<63): the top bit of h is replaced by the record flag
+        Link *n = find(b, reverse(h) | 1, k, true, &inserted);
+        if (inserted &&
+            n_records.fetch_add(1) + 1 > size * LOAD_FACTOR &&
+            size < (1ULL << (MAX_SEGMENTS-1))) {
+            n_buckets.compare_exchange_strong(size, size*2);
+        }
+        return static_cast<Node*>(n)->rec;
+    }
+
+    // f(key, record) for every record created so far, in hash order
+    template <class F>
+    void for_each(F f) {
+        for (Link *x = head.next.load(std::memory_order_acquire); x != nullptr;
+             x = x->next.load(std::memory_order_acquire)) {
+            if (x->so_key & 1) f(x->key, static_cast<Node*>(x)->rec);
+        }
+    }
+};
+
+#if PROCEDURE_INDEX
+template <class R> using Index = HashIndex<R>;
+#else
+template <class R> using Index = DirectIndex<R>;
+#endif
+
+} // namespace procedure
+
+#endif // PROCEDURE_INDEX_HPP
@@ -0,0 +1,215 @@
+// Multi-version timestamp ordering (mvto/ex1.cpp with VERSION_RTS and
+// DEFERRED_WRITE).
+// Each record keeps a chain of versions, newest first, under a short
+// per-record spin lock.  A read takes the newest version not newer than
+// the transaction's timestamp and raises its rts; at commit the writes are
+// installed as pending versions (rejected if the preceding version was read
+// by a later transaction) and then marked committed.  Versions older than
+// the one the oldest active transaction can read are freed after commits.
+
+#ifndef PROCEDURE_MVTO_HPP
+#define PROCEDURE_MVTO_HPP
+
+#include <algorithm>
+#include "procedure.hpp"
+#include "index.hpp"
+
+namespace procedure {
+
+struct MVTO {
+    static constexpr const char *name = "mvto";
+
+    enum {COMMITTED=0, PENDING=1};
+
+    struct Version {
+        long wts;
+        long rts;
+        Value value;
+        std::atomic<int> status;
+        Version *next;
+    };
+
+    struct Record {
+        SpinLock lock;
+        Version *head = new Version{0, 0, ABSENT, {COMMITTED}, nullptr};
+        long gc_watermark = 0;   // watermark of the last gc
+
+        ~Record() {
+            for (Version *x = head, *y; x != nullptr; x = y) {
+                y = x->next;
+                delete x;
+            }
+        }
+    };
+
+    class Txn;
+
+    class Database {
+        struct alignas(64) ActiveSlot {
+            std::atomic<long> ts{0};   // 0: no active transaction
+        };
+        Index<Record> records;
+        std::vector<ActiveSlot> active;
+        alignas(64) std::atomic<long> global_ts{1};
+        friend class Txn;
+
+        long min_active_timestamp() {
+            long ts = global_ts.load();
+            for (auto &a : active) {
+                long t = a.ts.load();
+                if (t != 0 && t < ts) ts = t;
+            }
+            return ts;
+        }
+
+    public:
+        Database(int n_records, int n_threads) : records(n_records), active(n_threads) {}
+
+        VersionStats version_stats() {
+            VersionStats st;
+            records.for_each([&st](Key, Record &r) {
+                long n = 0;
+                r.lock.lock();
+                for (Version *x = r.head; x != nullptr; x = x->next) {
+                    n++;
+                }
+                r.lock.unlock();
+                st.n_versions += n;
+                st.max_chain = std::max(st.max_chain, n);
+            });
+            st.gc_lag = global_ts.load() - min_active_timestamp();
+            return st;
+        }
+    };
+
+    class Txn : public TxnBase<Txn> {
+        Database &db;
+        int thread_id;
+        long ts = 0;
+        std::vector<std::pair<Key,Version*>> installed;
+
+        // keep the newest version with wts <= watermark and drop the older ones;
+        // while a stalled transaction holds the watermark back the chain only
+        // grows, so it is walked once per advance rather than per commit
+        void gc(Record &r, long watermark) {
+            if (watermark <= r.gc_watermark) return;
+            r.gc_watermark = watermark;
+            Version *keep = r.head;
+            while (keep->wts > watermark || keep->status.load() != COMMITTED) {
+                keep = keep->next;
+                if (keep == nullptr) return;
+            }
+            Version *x = keep->next;
+            keep->next = nullptr;
+            while (x != nullptr) {
+                Version *y = x->next;
+                delete x;
+                x = y;
+            }
+        }
+
+    public:
+        Txn(Database &db, int thread_id) : db(db), thread_id(thread_id) {}
+
+        void begin() {
+            reset();
+            installed.clear();
+            // publish a lower bound first, so the GC watermark cannot pass us
+            db.active[thread_id].ts.store(db.global_ts.load());
+            ts = db.global_ts.fetch_add(1);
+            db.active[thread_id].ts.store(ts);
+#if HISTORY
+            hist_ts = ts;
+#endif
+        }
+
+        Value read(Key k) {
+            if (abort_flag) return ABSENT;
+            if (const Value *w = find_write(k)) return *w;
+            Record &r = db.records.get(k);
+            for (;;) {
+                r.lock.lock();
+                Version *x = r.head;
+                while (x->wts > ts) {
+                    x = x->next;
+                }
+                if (x->status.load() == PENDING) {
+                    // an older transaction is committing; its outcome decides what we read
+                    r.lock.unlock();
+                    cpu_relax();
+                    continue;
+                }
+                if (x->rts < ts) x->rts = ts;
+#if HISTORY
+                record_read(k, x->wts);
+#endif
+                Value v = x->value;
+                r.lock.unlock();
+                return v;
+            }
+        }
+
+        void write(Key k, Value v) {
+            if (abort_flag) return;
+            buffer_write(k, v);
+        }
+
+        bool commit() {
+            if (!abort_flag) {
+                for (auto &w : write_set) {
+                    Record &r = db.records.get(w.first);
+                    r.lock.lock();
+                    Version **p = &r.head;
+                    while ((*p)->wts > ts) {
+                        p = &(*p)->next;
+                    }
+                    // the preceding version was read by a later transaction
+                    if ((*p)->rts > ts) {
+                        long rts = (*p)->rts;
+                        r.lock.unlock();
+                        set_abort(CF_LATE_WRITE, w.first, rts);
+                        break;
+                    }
+                    Version *m = new Version{ts, 0, w.second, {PENDING}, *p};
+                    *p = m;
+                    r.lock.unlock();
+                    installed.emplace_back(w.first, m);
+                }
+            }
+            if (abort_flag) {
+                for (auto &i : installed) {
+                    Record &r = db.records.get(i.first);
+                    r.lock.lock();
+                    Version **p = &r.head;
+                    while (*p != i.second) {
+                        p = &(*p)->next;
+                    }
+                    *p = i.second->next;
+                    r.lock.unlock();
+                    delete i.second;
+                }
+                db.active[thread_id].ts.store(0);
+                return false;
+            }
+            for (auto &i : installed) {
+                i.second->status.store(COMMITTED);
+#if HISTORY
+                record_write(i.first, ts);
+#endif
+            }
+            db.active[thread_id].ts.store(0);
+            long watermark = db.min_active_timestamp() - 1;
+            for (auto &i : installed) {
+                Record &r = db.records.get(i.first);
+                r.lock.lock();
+                gc(r, watermark);
+                r.lock.unlock();
+            }
+            return true;
+        }
+    };
+};
+
+} // namespace procedure
+
+#endif // PROCEDURE_MVTO_HPP
@@ -0,0 +1,103 @@
+// Backward-validation OCC (the 1st algorithm of occ/ex1.c).
+// Reads remember the version of each record; validation and the write
+// phase run in one critical section on a giant lock, so a read is valid if
+// its record has not been written since.
+
+#ifndef PROCEDURE_OCC_HPP
+#define PROCEDURE_OCC_HPP
+
+#include <mutex>
+#include "procedure.hpp"
+#include "index.hpp"
+
+namespace procedure {
+
+struct OCC {
+    static constexpr const char *name = "occ";
+
+    struct Record {
+        std::atomic<long> version{0};    // commit number of the last writer
+        std::atomic<Value> value{ABSENT};
+    };
+
+    class Txn;
+
+    class Database {
+        Index<Record> records;
+        std::mutex giant_lock;
+        long tn = 0;                     // transaction number counter
+        friend class Txn;
+    public:
+        Database(int n_records, int) : records(n_records) {}
+    };
+
+    class Txn : public TxnBase<Txn> {
+        Database &db;
+        struct ReadEntry {
+            Key key;
+            Record *rec;
+            long version;
+        };
+        std::vector<ReadEntry> read_set;
+        std::vector<Record*> write_rec;
+
+    public:
+        Txn(Database &db, int) : db(db) {}
+
+        void begin() {
+            reset();
+            read_set.clear();
+        }
+
+        Value read(Key k) {
+            if (abort_flag) return ABSENT;
+            if (const Value *w = find_write(k)) return *w;
+            Record &r = db.records.get(k);
+            // the writer stores the value before the version, so a value
+            // newer than the version read here fails validation
+            long ver = r.version.load(std::memory_order_acquire);
+            Value v = r.value.load(std::memory_order_relaxed);
+            read_set.push_back(ReadEntry{k, &r, ver});
+#if HISTORY
+            record_read(k, ver);
+#endif
+            return v;
+        }
+
+        void write(Key k, Value v) {
+            if (abort_flag) return;
+            buffer_write(k, v);
+        }
+
+        bool commit() {
+            if (abort_flag) return false;
+            // look the records up before entering the critical section
+            write_rec.clear();
+            for (auto &w : write_set) {
+                write_rec.push_back(&db.records.get(w.first));
+            }
+            std::lock_guard<std::mutex> lock(db.giant_lock);
+            for (auto &r : read_set) {
+                long ver = r.rec->version.load();
+                if (ver != r.version) {
+                    // written by transaction number ver
+                    set_abort(CF_WRITESET, r.key, ver);
+                    return false;
+                }
+            }
+            long tn = ++db.tn;
+            for (std::size_t i=0; i<write_set.size(); i++) {
+                write_rec[i]->value.store(write_set[i].second, std::memory_order_relaxed);
+                write_rec[i]->version.store(tn, std::memory_order_release);
+#if HISTORY
+                record_write(write_set[i].first, tn);
+#endif
+            }
+            return true;
+        }
+    };
+};
+
+} // namespace procedure
+
+#endif // PROCEDURE_OCC_HPP
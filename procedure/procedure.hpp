@@ -0,0 +1,291 @@
+// Stored procedures written once and run on every engine.
+//
+// A procedure is a template over the transaction context:
+//
+//   template <class Txn> void proc(Txn &tx, ...) {
+//       Value v = tx.read(k);
+//       tx.write(k, v+1);
+//   }
+//
+// An engine is a policy class E with
+//   E::name                       engine name for the report
+//   E::Database(n_records, n_threads)
+//   E::Txn(E::Database&, thread_id) with
+//     void  begin()               start an attempt (the context is reused)
+//     Value read(Key)             ABSENT if the record does not exist
+//     void  write(Key, Value)
+//     bool  commit()              false: aborted, run the procedure again
+//   and insert()/remove()/scan()/aborted() from TxnBase.
+// An engine aborts with set_abort(cause, key, other transaction), and run()
+// prints the causes and the hot keys (conflict/conflict.h) if any aborted.
+// A multi-version engine may also have
+//   VersionStats E::Database::version_stats()
+// Records are found through Index<Record> (index.hpp).
+//
+// run<E>() calls the procedure through the concrete E::Txn type, so every
+// operation is inlined into the engine's code without virtual calls.
+// An operation that must abort only sets the abort flag; the following
+// operations do nothing and commit() returns false.
+//
+// HISTORY=1: between history_open() and history_close(), run() records the
+// committed transactions for history/check.  An engine gives the version
+// of each read and write with record_read()/record_write(), and its
+// timestamp (if it has one) in hist_ts.
+
+#ifndef PROCEDURE_HPP
+#define PROCEDURE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../conflict/conflict.h"
+
+#ifndef HISTORY
+#define HISTORY 0
+#endif
+#if HISTORY
+#include "../history/history.h"
+#endif
+
+namespace procedure {
+
+typedef std::uint64_t Key;
+typedef int Value;
+
+static const Value ABSENT = INT_MIN;
+
+inline void cpu_relax()
+{
+    std::this_thread::yield();
+}
+
+// test-and-test-and-set lock for the engines that need a short critical
+// section per record
+class SpinLock {
+    std::atomic<bool> locked{false};
+public:
+    void lock() {
+        for (;;) {
+            if (!locked.load(std::memory_order_relaxed) &&
+                !locked.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+            cpu_relax();
+        }
+    }
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+};
+
+// Write buffer and the operations shared by all engines (CRTP).
+template <class Derived>
+class TxnBase {
+protected:
+    std::vector<std::pair<Key,Value>> write_set;
+    bool abort_flag = false;
+    int abort_cause = CF_VALIDATE;  // the last abort, see set_abort()
+    Key abort_key = 0;
+    long abort_with = -1;
+#if HISTORY
+    std::vector<std::pair<Key,long>> hist_reads, hist_writes;  // key, version
+    long hist_ts = 0;
+
+    void record_read(Key k, long version) {hist_reads.emplace_back(k, version);}
+    void record_write(Key k, long version) {hist_writes.emplace_back(k, version);}
+#endif
+
+    void reset() {
+        write_set.clear();
+        abort_flag = false;
+#if HISTORY
+        hist_reads.clear();
+        hist_writes.clear();
+#endif
+    }
+
+    const Value *find_write(Key k) const {
+        for (auto &w : write_set) {
+            if (w.first == k) return &w.second;
+        }
+        return nullptr;
+    }
+
+    void buffer_write(Key k, Value v) {
+        for (auto &w : write_set) {
+            if (w.first == k) {
+                w.second = v;
+                return;
+            }
+        }
+        write_set.emplace_back(k, v);
+    }
+
+    Derived &self() {return static_cast<Derived&>(*this);}
+
+    // with: the engine's id of the other transaction, -1 if unknown
+    void set_abort(int cause, Key k, long with) {
+        abort_flag = true;
+        abort_cause = cause;
+        abort_key = k;
+        abort_with = with;
+    }
+
+public:
+    bool aborted() const {return abort_flag;}
+
+    void add_conflict(CONFLICTS *c) const {
+        conflict_add(c, abort_cause, abort_key, abort_with);
+    }
+
+#if HISTORY
+    // the committed attempt
+    void add_history(HIST_BUF *b) const {
+        hist_begin(b, hist_ts);
+        for (auto &r : hist_reads) hist_read(b, (std::int64_t)r.first, r.second);
+        for (auto &w : hist_writes) hist_write(b, (std::int64_t)w.first, w.second);
+        hist_commit(b);
+    }
+#endif
+
+    // false if the record already exists
+    bool insert(Key k, Value v) {
+        if (self().read(k) != ABSENT) return false;
+        self().write(k, v);
+        return true;
+    }
+
+    // false if the record does not exist
+    bool remove(Key k) {
+        if (self().read(k) == ABSENT) return false;
+        self().write(k, ABSENT);
+        return true;
+    }
+
+    // f(key, value) for each existing record in [lo, hi); a point read per
+    // key, so only for dense key ranges
+    template <class F>
+    void scan(Key lo, Key hi, F f) {
+        for (Key k=lo; k<hi && !abort_flag; k++) {
+            Value v = self().read(k);
+            if (v != ABSENT) f(k, v);
+        }
+    }
+};
+
+// version chains of a multi-version engine at one moment
+struct VersionStats {
+    long n_versions = 0;  // versions of all records
+    long max_chain = 0;   // longest chain of one record
+    long gc_lag = 0;      // timestamps the GC watermark is behind the newest one
+};
+
+#if HISTORY
+// Buffer of each thread id, kept from history_open() to history_close()
+// so that the transactions of every run() on one database are in one
+// history.  Open one per database: the keys of two databases are the same.
+inline std::vector<HIST_BUF> &history_bufs()
+{
+    static std::vector<HIST_BUF> bufs;
+    return bufs;
+}
+
+inline void history_open(const char *path, int n_threads)
+{
+    hist_open_file(path);
+    history_bufs().resize(n_threads);
+    for (int t=0; t<n_threads; t++) {
+        hist_init(&history_bufs()[t], t);
+    }
+}
+
+inline void history_close()
+{
+    for (auto &b : history_bufs()) {
+        hist_finish(&b);
+    }
+    history_bufs().clear();
+    hist_close();
+}
+#endif
+
+struct Stats {
+    long n_commit = 0;
+    long n_abort = 0;
+    double t_elap = 0;  // slowest thread
+};
+
+// Run proc(tx, i) for i in [0, n) on thread thread_id until each commits;
+// the aborts are added to conflicts if given.
+template <class Engine, class Proc>
+Stats run_thread(typename Engine::Database &db, int thread_id, int n, Proc proc,
+                 CONFLICTS *conflicts = nullptr)
+{
+    Stats st;
+    auto t0 = std::chrono::steady_clock::now();
+    typename Engine::Txn tx(db, thread_id);
+#if HISTORY
+    HIST_BUF *hist = (thread_id < (int)history_bufs().size()) ? &history_bufs()[thread_id] : nullptr;
+#endif
+
+    for (int i=0; i<n; i++) {
+        for (int backoff=1; ; backoff = (backoff < 1024) ? backoff*2 : backoff) {
+            tx.begin();
+            proc(tx, i);
+            if (tx.commit()) {
+#if HISTORY
+                if (hist != nullptr) tx.add_history(hist);
+#endif
+                break;
+            }
+            if (conflicts != nullptr) tx.add_conflict(conflicts);
+            st.n_abort++;
+            std::this_thread::sleep_for(std::chrono::nanoseconds(backoff));
+        }
+        st.n_commit++;
+    }
+    st.t_elap = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+    return st;
+}
+
+// proc(tx, thread_id, i) for i in [0, n_per_thread) on n_threads threads
+template <class Engine, class Proc>
+Stats run(typename Engine::Database &db, int n_threads, int n_per_thread, Proc proc)
+{
+    std::vector<std::thread> thv;
+    std::vector<Stats> st(n_threads);
+    std::vector<CONFLICTS> conflicts(n_threads);
+    for (int t=0; t<n_threads; t++) {
+        conflict_init(&conflicts[t]);
+        thv.emplace_back([&db, &st, &conflicts, t, n_per_thread, proc]() {
+            st[t] = run_thread<Engine>(db, t, n_per_thread,
+                                       [t, &proc](typename Engine::Txn &tx, int i) {proc(tx, t, i);},
+                                       &conflicts[t]);
+        });
+    }
+    Stats sum;
+    CONFLICTS conflict_total;
+    conflict_init(&conflict_total);
+    for (int t=0; t<n_threads; t++) {
+        thv[t].join();
+        conflict_merge(&conflict_total, &conflicts[t]);
+        sum.n_commit += st[t].n_commit;
+        sum.n_abort += st[t].n_abort;
+        if (st[t].t_elap > sum.t_elap) sum.t_elap = st[t].t_elap;
+    }
+    if (sum.n_abort > 0) {
+        char who[32];
+        snprintf(who, sizeof(who), "%-5s: ", Engine::name);
+        conflict_print_top(&conflict_total, who);
+    }
+    free(conflict_total.slot);
+    return sum;
+}
+
+} // namespace procedure
+
+#endif // PROCEDURE_HPP
@@ -0,0 +1,135 @@
+// Silo (silo/ex2.c).
+// Each record has a tid word with a lock bit.  Reads take a stable
+// (tid, value) snapshot; commit locks the write set in key order, checks
+// that every read tid is unchanged and not locked by someone else, and
+// writes with a tid larger than every tid it saw.
+
+#ifndef PROCEDURE_SILO_HPP
+#define PROCEDURE_SILO_HPP
+
+#include <algorithm>
+#include "procedure.hpp"
+#include "index.hpp"
+
+namespace procedure {
+
+struct Silo {
+    static constexpr const char *name = "silo";
+
+    struct Record {
+        std::atomic<unsigned long> tid{0};  // tid << 1 | lock bit
+        std::atomic<Value> value{ABSENT};
+    };
+
+    class Txn;
+
+    class Database {
+        Index<Record> records;
+        friend class Txn;
+    public:
+        Database(int n_records, int) : records(n_records) {}
+    };
+
+    class Txn : public TxnBase<Txn> {
+        static const unsigned long LOCK_BIT = 1;
+        Database &db;
+        struct ReadEntry {
+            Key key;
+            Record *rec;
+            unsigned long tid;
+        };
+        std::vector<ReadEntry> read_set;
+        std::vector<Record*> write_rec;   // records of write_set after the sort
+
+        void lock(Record &r) {
+            std::atomic<unsigned long> &t = r.tid;
+            for (;;) {
+                unsigned long w = t.load();
+                if (!(w & LOCK_BIT) && t.compare_exchange_weak(w, w|LOCK_BIT)) return;
+                cpu_relax();
+            }
+        }
+
+        bool in_write_set(Key k) const {
+            return find_write(k) != nullptr;
+        }
+
+    public:
+        Txn(Database &db, int) : db(db) {}
+
+        void begin() {
+            reset();
+            read_set.clear();
+        }
+
+        Value read(Key k) {
+            if (abort_flag) return ABSENT;
+            if (const Value *w = find_write(k)) return *w;
+            Record &r = db.records.get(k);
+            unsigned long t1, t2;
+            Value v;
+            do {
+                while ((t1 = r.tid.load(std::memory_order_acquire)) & LOCK_BIT) {
+                    cpu_relax();
+                }
+                v = r.value.load(std::memory_order_acquire);
+                t2 = r.tid.load(std::memory_order_acquire);
+            } while (t1 != t2);
+            read_set.push_back(ReadEntry{k, &r, t1});
+#if HISTORY
+            record_read(k, t1 >> 1);
+#endif
+            return v;
+        }
+
+        void write(Key k, Value v) {
+            if (abort_flag) return;
+            buffer_write(k, v);
+        }
+
+        bool commit() {
+            if (abort_flag) return false;
+
+            // Phase 1 (lock)
+            std::sort(write_set.begin(), write_set.end());
+            write_rec.clear();
+            for (auto &w : write_set) {
+                write_rec.push_back(&db.records.get(w.first));
+                lock(*write_rec.back());
+            }
+
+            // Phase 2 (validate)
+            unsigned long max_tid = 0;
+            for (auto &r : read_set) {
+                unsigned long t = r.rec->tid.load();
+                bool changed = (t & ~LOCK_BIT) != r.tid;
+                if (changed || ((t & LOCK_BIT) && !in_write_set(r.key))) {
+                    for (Record *w : write_rec) {
+                        w->tid.fetch_and(~LOCK_BIT);
+                    }
+                    set_abort(changed ? CF_VALIDATE : CF_LOCKED, r.key, t >> 1);
+                    return false;
+                }
+                max_tid = std::max(max_tid, r.tid);
+            }
+            for (Record *w : write_rec) {
+                max_tid = std::max(max_tid, w->tid.load() & ~LOCK_BIT);
+            }
+
+            // Phase 3 (write and unlock)
+            unsigned long commit_tid = max_tid + 2;
+            for (std::size_t i=0; i<write_set.size(); i++) {
+                write_rec[i]->value.store(write_set[i].second, std::memory_order_release);
+                write_rec[i]->tid.store(commit_tid, std::memory_order_release);
+#if HISTORY
+                record_write(write_set[i].first, commit_tid >> 1);
+#endif
+            }
+            return true;
+        }
+    };
+};
+
+} // namespace procedure
+
+#endif // PROCEDURE_SILO_HPP
@@ -0,0 +1,140 @@
+// Two-phase locking with NO_WAIT.
+// twopl/ex1.c locks the whole read/write set in key order up front; a
+// procedure discovers its keys one at a time, so a lock that is not
+// available aborts the transaction instead of waiting (no deadlock).
+// Writes are buffered and applied at commit under the exclusive locks.
+
+#ifndef PROCEDURE_TWOPL_HPP
+#define PROCEDURE_TWOPL_HPP
+
+#include "procedure.hpp"
+#include "index.hpp"
+
+namespace procedure {
+
+struct TwoPL {
+    static constexpr const char *name = "2pl";
+
+    struct Record {
+        std::atomic<int> lock{0};   // -1: exclusive, n > 0: n shared holders
+        std::atomic<Value> value{ABSENT};
+#if HISTORY
+        long version = 0;           // write counter under the exclusive lock
+#endif
+    };
+
+    class Txn;
+
+    class Database {
+        Index<Record> records;
+        friend class Txn;
+    public:
+        Database(int n_records, int) : records(n_records) {}
+    };
+
+    class Txn : public TxnBase<Txn> {
+        enum {SHARED=1, EXCLUSIVE=2};
+        Database &db;
+        struct LockEntry {
+            Key key;
+            Record *rec;
+            int mode;
+        };
+        std::vector<LockEntry> lock_set;
+
+        LockEntry *held(Key k) {
+            for (auto &l : lock_set) {
+                if (l.key == k) return &l;
+            }
+            return nullptr;
+        }
+
+        bool lock_shared(Key k) {
+            Record &r = db.records.get(k);
+            int n = r.lock.load();
+            do {
+                if (n < 0) return false;
+            } while (!r.lock.compare_exchange_weak(n, n+1));
+            lock_set.push_back(LockEntry{k, &r, SHARED});
+            return true;
+        }
+
+        bool lock_exclusive(Key k) {
+            LockEntry *h = held(k);
+            if (h != nullptr && h->mode == EXCLUSIVE) return true;
+            Record &r = (h != nullptr) ? *h->rec : db.records.get(k);
+            int expected = (h != nullptr) ? 1 : 0;  // upgrade only as the sole reader
+            if (!r.lock.compare_exchange_strong(expected, -1)) return false;
+            if (h != nullptr) {
+                h->mode = EXCLUSIVE;
+            } else {
+                lock_set.push_back(LockEntry{k, &r, EXCLUSIVE});
+            }
+            return true;
+        }
+
+        void release() {
+            for (auto &h : lock_set) {
+                if (h.mode == EXCLUSIVE) {
+                    h.rec->lock.store(0);
+                } else {
+                    h.rec->lock.fetch_sub(1);
+                }
+            }
+            lock_set.clear();
+        }
+
+    public:
+        Txn(Database &db, int) : db(db) {}
+
+        void begin() {
+            reset();
+        }
+
+        Value read(Key k) {
+            if (abort_flag) return ABSENT;
+            if (const Value *w = find_write(k)) return *w;
+            LockEntry *h = held(k);
+            if (h == nullptr) {
+                if (!lock_shared(k)) {
+                    set_abort(CF_LOCKED, k, -1);
+                    return ABSENT;
+                }
+                h = &lock_set.back();
+            }
+#if HISTORY
+            record_read(k, h->rec->version);
+#endif
+            return h->rec->value.load(std::memory_order_relaxed);
+        }
+
+        void write(Key k, Value v) {
+            if (abort_flag) return;
+            if (!lock_exclusive(k)) {
+                set_abort(CF_LOCKED, k, -1);
+                return;
+            }
+            buffer_write(k, v);
+        }
+
+        bool commit() {
+            if (!abort_flag) {
+                // every exclusive lock has a buffered write
+                for (auto &h : lock_set) {
+                    if (h.mode == EXCLUSIVE) {
+                        h.rec->value.store(*find_write(h.key), std::memory_order_relaxed);
+#if HISTORY
+                        record_write(h.key, ++h.rec->version);
+#endif
+                    }
+                }
+            }
+            release();
+            return !abort_flag;
+        }
+    };
+};
+
+} // namespace procedure
+
+#endif // PROCEDURE_TWOPL_HPP
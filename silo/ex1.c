@@ -4,13 +4,35 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
+#include "../trace/trace.h"
+#include "../phase/phase.h"
+#include "../conflict/conflict.h"
 
 #define DEBUG 0
 
+// 1: validate the read set packed into key/tid arrays with AVX-512 or AVX2
+//    gathers, as in ex2.c
+#ifndef VALIDATE_SIMD
+#define VALIDATE_SIMD 0
+#endif
+#if VALIDATE_SIMD
+#include <immintrin.h>
+#endif
+
+// 1: record the committed transactions to HISTORY_FILE for history/check
+//    (read version: the tid seen, write version: the commit tid)
+#ifndef HISTORY
+#define HISTORY 0
+#endif
+#if HISTORY
+#include "../history/history.h"
+#endif
+
 #if DEBUG
 #define NUM_THREADS 4
 #define NUM_DATA 5
@@ -40,9 +62,15 @@ typedef struct _XACT {
     TYPE type;
 } XACT;
 
+typedef struct _THREAD_ARGS {
+    int   id;
+    XACT *xact;
+} THREAD_ARGS;
+
 DATA Database[NUM_DATA];
 pthread_t threads[NUM_THREADS];
 XACT xact[TX_LEN*N_REPEAT][NUM_THREADS];
+XACT *thread_xact[NUM_THREADS];
 
 static struct timespec start_time;
 
@@ -58,12 +86,66 @@ int get_time()
     return (t.tv_sec - start_time.tv_sec)*1000000 + t.tv_nsec/1000;
 }
 
+#if VALIDATE_SIMD
+// Database[] as ints: record k is at k*DATA_INTS, its tid at TID_INT and
+// its locked flag in the low byte of LOCK_INT (the padding after it is never
+// written)
+#define DATA_INTS (int)(sizeof(DATA)/sizeof(int))
+#define TID_INT   (int)(offsetof(DATA, tid)/sizeof(int))
+#define LOCK_INT  (int)(offsetof(DATA, locked)/sizeof(int))
+_Static_assert(sizeof(DATA) % sizeof(int) == 0 && offsetof(DATA, locked) % sizeof(int) == 0,
+               "DATA is not a whole number of ints");
+
+// the n reads of key[] saw tid[]; ronly[i] is -1 if key[i] is read only, so
+// that it must not be locked by another transaction, 0 otherwise
+static bool validate_reads(const int *key, const int *tid, const int *ronly, int n)
+{
+    int i = 0;
+
+#if defined(__AVX512F__)
+    const int *base = (const int*)Database;
+    const __m512i stride = _mm512_set1_epi32(DATA_INTS);
+    const __m512i byte = _mm512_set1_epi32(0xff);
+    for (; i<n; i+=16) {
+        __mmask16 m = (n-i >= 16) ? 0xffff : (__mmask16)((1u << (n-i)) - 1);
+        __m512i idx = _mm512_mullo_epi32(_mm512_maskz_loadu_epi32(m, key+i), stride);
+        __m512i t = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx, base+TID_INT, 4);
+        __m512i l = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx, base+LOCK_INT, 4);
+        l = _mm512_and_si512(l, byte);
+        if (_mm512_mask_cmpneq_epi32_mask(m, t, _mm512_maskz_loadu_epi32(m, tid+i)) ||
+            _mm512_mask_test_epi32_mask(m, l, _mm512_maskz_loadu_epi32(m, ronly+i))) {
+            return false;
+        }
+    }
+#elif defined(__AVX2__)
+    const int *base = (const int*)Database;
+    const __m256i stride = _mm256_set1_epi32(DATA_INTS);
+    const __m256i byte = _mm256_set1_epi32(0xff);
+    for (; i+8<=n; i+=8) {
+        __m256i idx = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(key+i)), stride);
+        __m256i t = _mm256_i32gather_epi32(base+TID_INT, idx, 4);
+        __m256i l = _mm256_and_si256(_mm256_i32gather_epi32(base+LOCK_INT, idx, 4), byte);
+        __m256i bad = _mm256_or_si256(
+            _mm256_xor_si256(t, _mm256_loadu_si256((const __m256i*)(tid+i))),
+            _mm256_and_si256(l, _mm256_loadu_si256((const __m256i*)(ronly+i))));
+        if (!_mm256_testz_si256(bad, bad)) return false;
+    }
+#endif
+    for (; i<n; i++) {
+        if (Database[key[i]].tid != tid[i] || (ronly[i] && Database[key[i]].locked)) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
 #define LOCK(k)                                 \
     {                                           \
-        t = get_time();                         \
+        t = phase_now();                        \
         pthread_mutex_lock(&Database[k].lock);  \
         Database[k].locked = true;              \
-        tsum += get_time() - t;                 \
+        tsum += phase_now() - t;                \
 }
 #define UNLOCK(k)                               \
     {                                           \
@@ -71,18 +153,48 @@ int get_time()
         pthread_mutex_unlock(&Database[k].lock);\
     }
 
+// Record why the validation failed: the first read whose tid changed, or
+// else the first read-only record locked by another transaction
+static void add_abort(CONFLICTS *c, const TYPE *type, const int *tid)
+{
+    for (int k=0; k<NUM_DATA; k++) {
+        if ((type[k] & READ) && tid[k] != Database[k].tid) {
+            conflict_add(c, CF_VALIDATE, k, Database[k].tid);
+            return;
+        }
+    }
+    for (int k=0; k<NUM_DATA; k++) {
+        if (type[k] == READ && Database[k].locked) {
+            conflict_add(c, CF_LOCKED, k, Database[k].tid);
+            return;
+        }
+    }
+    conflict_add(c, CF_VALIDATE, -1, -1);
+}
+
 void *worker(void *arg)
 {
     TYPE type[NUM_DATA];
     int  val[NUM_DATA];
     int  tid[NUM_DATA];
-    XACT *xact = (XACT*)arg;
-    int t, tsum = 0;
+#if VALIDATE_SIMD
+    int  rkey[NUM_DATA], rtid[NUM_DATA], ronly[NUM_DATA];
+    int  n_read;
+#endif
+    XACT *xact = ((THREAD_ARGS*)arg)->xact;
+    int thread_id = ((THREAD_ARGS*)arg)->id;
+    uint64_t t, tsum = 0;
     int t_begin = get_time(), t_end;
     double t_elap, t_lock;
     int n_abort=0;
     int n_commit=0;
     int commit_tid;
+    CONFLICTS conflicts;
+    conflict_init(&conflicts);
+#if HISTORY
+    HIST_BUF hist;
+    hist_init(&hist, thread_id);
+#endif
 
     for (int repeat=0; repeat < N_REPEAT; repeat++) {
 
@@ -101,6 +213,9 @@ void *worker(void *arg)
 
         // read phase
         commit_tid = 0;
+#if VALIDATE_SIMD
+        n_read = 0;
+#endif
         for (int k=0; k<NUM_DATA; k++) {
             // read data
             if (type[k] & READ) {
@@ -108,6 +223,12 @@ void *worker(void *arg)
                 val[k] = Database[k].val;
                 tid[k] = t = Database[k].tid;
                 if (t > commit_tid) commit_tid = t;
+#if VALIDATE_SIMD
+                rkey[n_read] = k;
+                rtid[n_read] = tid[k];
+                ronly[n_read] = (type[k] == READ) ? -1 : 0;
+                n_read++;
+#endif
             }
         }
 
@@ -129,19 +250,29 @@ void *worker(void *arg)
 
         //printf("%d:phase2\n",repeat);
         // Phase 2 (validate)
+        bool valid = true;
+#if VALIDATE_SIMD
+        valid = validate_reads(rkey, rtid, ronly, n_read);
+#else
         for (int k=0; k<NUM_DATA; k++) {
             if ( ((type[k]&READ) && tid[k]!=Database[k].tid) ||
                  ((type[k]==READ) && Database[k].locked) ) {
-                // unlock write set
-                for (int j=0; j<NUM_DATA; j++) {
-                    if (type[j] & WRITE) {
-                        UNLOCK(j);
-                    }
+                valid = false;
+                break;
+            }
+        }
+#endif
+        if (!valid) {
+            // unlock write set
+            for (int j=0; j<NUM_DATA; j++) {
+                if (type[j] & WRITE) {
+                    UNLOCK(j);
                 }
-                n_abort += 1;
-                usleep(3);
-                goto retry;
             }
+            add_abort(&conflicts, type, tid);
+            n_abort += 1;
+            usleep(3);
+            goto retry;
         }
         // commit tid
         for (int k=0; k<NUM_DATA; k++) {
@@ -152,6 +283,16 @@ void *worker(void *arg)
         }
         commit_tid++;
 
+#if HISTORY
+        // the reads are validated and the write set is locked
+        hist_begin(&hist, 0);
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] & READ) hist_read(&hist, k, tid[k]);
+            if (type[k] & WRITE) hist_write(&hist, k, commit_tid);
+        }
+        hist_commit(&hist);
+#endif
+
 #if DEBUG
         for (int i=0; i<TX_LEN; i++) {
             printf(" %c%d",(xact[i].type==READ) ? 'r':'w', xact[i].key);
@@ -177,17 +318,22 @@ void *worker(void *arg)
         xact += TX_LEN;
     }
     t_end = get_time();
+#if HISTORY
+    hist_finish(&hist);
+#endif
     t_elap = (t_end-t_begin)*1e-6;
-    t_lock = tsum*1e-6;
+    t_lock = tsum/phase_tsc_hz();
     printf("time: elap=%f lock=%f lock_ratio=%f n_abort=%d n_commit=%d\n",
            t_elap,t_lock,t_lock/t_elap,n_abort,n_commit);
+    conflict_report(&conflicts, thread_id);
 
     return NULL;
 }
 
 
-int main(){
+int main(int argc, char *argv[]){
     int i, j, sum;
+    THREAD_ARGS thread_args[NUM_THREADS];
 
     // Initialize Database
     for (i=0; i<NUM_DATA; i++) {
@@ -199,36 +345,58 @@ int main(){
 
     // Create Transaction
     sum = 0;
-    for(i=0; i<NUM_THREADS; i++){
+    if (argc > 1) {
+        // replay the trace argv[1] instead of generating the transactions
+        const TRACE_HEADER *h = trace_open(argv[1], NUM_THREADS, TX_LEN, N_REPEAT, NUM_DATA);
+        for (i=0; i<NUM_THREADS; i++) {
+            thread_xact[i] = TRACE_XACT(h, i);
+        }
+        sum = trace_n_read(h, NUM_THREADS, N_REPEAT);
+    } else {
+        for(i=0; i<NUM_THREADS; i++){
 #if DEBUG
-        printf("thread%d:",i);
+            printf("thread%d:",i);
 #endif
-        for(j=0; j<TX_LEN*N_REPEAT; j++){
-            xact[j][i].type = (random()&1) ? READ : WRITE;
-            xact[j][i].key = (int)(random()/(1.0+RAND_MAX) * NUM_DATA);
+            for(j=0; j<TX_LEN*N_REPEAT; j++){
+                xact[j][i].type = (random()&1) ? READ : WRITE;
+                xact[j][i].key = (int)(random()/(1.0+RAND_MAX) * NUM_DATA);
 #if DEBUG
-            printf(" %c%d",(xact[j][i].type==READ) ? 'r':'w', xact[j][i].key);
+                printf(" %c%d",(xact[j][i].type==READ) ? 'r':'w', xact[j][i].key);
 #endif
-            if (xact[j][i].type==READ) {
-                sum += 1;
+                if (xact[j][i].type==READ) {
+                    sum += 1;
+                }
             }
-        }
 #if DEBUG
-        printf("\n");
+            printf("\n");
 #endif
+        }
+        for(i=0; i<NUM_THREADS; i++){
+            thread_xact[i] = xact[i];
+        }
     }
     printf("# of READ=%d\n",sum);
+#if HISTORY
+    hist_open();
+#endif
     init_time();
 
     // Start threads
     for(i=0; i<NUM_THREADS; i++) {
-        pthread_create(&threads[i], NULL, worker, &xact[i]);
+        thread_args[i].id = i;
+        thread_args[i].xact = thread_xact[i];
+        pthread_create(&threads[i], NULL, worker, &thread_args[i]);
     }
 
     // Join threads
     for(i=0; i<NUM_THREADS; i++) {
         pthread_join(threads[i], NULL);
     }
+    conflict_report_total();
+#if HISTORY
+    hist_close();
+    printf("history: %s\n", HISTORY_FILE);
+#endif
 
     // Print result
     sum = 0;
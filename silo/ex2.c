@@ -4,27 +4,108 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
+#include "../trace/trace.h"
+#include "../conflict/conflict.h"
 
 #define DEBUG 0
 
+// partitioned workload of hstore/ex1.c with MP_PERCENT% multi-partition
+// transactions instead of uniform keys
+//#define MP_PERCENT 10
+
+// 1: on a failed validation, re-read only the stale keys and recompute their
+//    values while keeping the write set locked (up to REPAIR_MAX times)
+#ifndef REPAIR
+#define REPAIR 0
+#endif
+#define REPAIR_MAX 3
+
+// 1: a key that is read and written is updated by a commutative delta
+//    applied at commit (no read, no validation), so such updates never abort
+// 2: as 1, with the deltas kept in per-thread slots of each record; a read
+//    merges the slots and a blind write resets them, so delta updates of the
+//    same record don't serialize on its lock either
+#ifndef DELTA
+#define DELTA 0
+#endif
+
+// delta operation: 0: add, 1: min, 2: max
+#ifndef DELTA_OP
+#define DELTA_OP 0
+#endif
+#if DELTA_OP == 1
+#define DELTA_IDENTITY INT_MAX
+#define APPLY_DELTA(x,d) ((d) < (x) ? (d) : (x))
+#elif DELTA_OP == 2
+#define DELTA_IDENTITY INT_MIN
+#define APPLY_DELTA(x,d) ((d) > (x) ? (d) : (x))
+#else
+#define DELTA_IDENTITY 0
+#define APPLY_DELTA(x,d) ((x) + (d))
+#endif
+
+// 1: validate the read set packed into key/tid arrays, gathering the tid
+//    and lock of 16 (AVX-512) or 8 (AVX2) records per instruction; the
+//    instruction set is the one the compiler targets (-march=native),
+//    plain C otherwise
+#ifndef VALIDATE_SIMD
+#define VALIDATE_SIMD 0
+#endif
+#if VALIDATE_SIMD
+#include <immintrin.h>
+#endif
+
+// 1: record the committed transactions to HISTORY_FILE for history/check
+//    (read version: the tid seen, write version: the commit tid)
+#ifndef HISTORY
+#define HISTORY 0
+#endif
+#if HISTORY
+#include "../history/history.h"
+#endif
+
+// 1: cycles per phase (read, modify, lock, validate, write, backoff),
+// 2: also perf counters per phase (see phase/phase.h)
+#ifndef PHASE_STATS
+#define PHASE_STATS 0
+#endif
+#include "../phase/phase.h"
+
 #if DEBUG
 #define NUM_THREADS 4
 #define NUM_DATA 5
 #define TX_LEN 5
 #define N_REPEAT (12/NUM_THREADS)
 #else
+#ifndef NUM_THREADS
 #define NUM_THREADS 4
+#endif
+#ifndef NUM_DATA
 #define NUM_DATA 10
 //#define NUM_DATA 30
+#endif
+#ifndef TX_LEN
 #define TX_LEN 30
 //#define TX_LEN 10
+#endif
+#ifndef N_REPEAT
 #define N_REPEAT (400000/NUM_THREADS)
 //#define N_REPEAT (4000/NUM_THREADS)
 #endif
+#endif
+
+#if VALIDATE_SIMD && DELTA == 2
+#error "VALIDATE_SIMD reads the tid of Database[k]; it does not merge slots (DELTA=2)"
+#endif
+#if HISTORY && DELTA == 2
+#error "HISTORY needs the tid of Database[k] as the version; it does not merge slots (DELTA=2)"
+#endif
 
 typedef struct _DATA {
     int val;
@@ -32,7 +113,7 @@ typedef struct _DATA {
     bool lock;
 } DATA;
 
-typedef enum {NONE=0, READ=1, WRITE=2} TYPE;
+typedef enum {NONE=0, READ=1, WRITE=2, DELTA_UPDATE=4} TYPE;
 
 typedef struct _XACT {
     int key;
@@ -45,6 +126,13 @@ typedef struct _THREAD_ARGS {
 } THREAD_ARGS;
 
 DATA Database[NUM_DATA];
+#if DELTA == 2
+// Slot[k][i]: deltas of thread i to record k, one cache line each
+typedef struct _SLOT {
+    DATA d;
+} __attribute__((aligned(64))) SLOT;
+SLOT Slot[NUM_DATA][NUM_THREADS];
+#endif
 pthread_t threads[NUM_THREADS];
 XACT xact[TX_LEN*N_REPEAT][NUM_THREADS];
 
@@ -62,17 +150,32 @@ int get_time()
     return (t.tv_sec - start_time.tv_sec)*1000000 + t.tv_nsec/1000;
 }
 
+#if DELTA == 2
+// a delta update locks only its own slot, a blind write the record and all slots
 #define LOCK(k)                                 \
     {                                           \
-        t = get_time();                         \
+        t = phase_now();                        \
+        lock_slots(k, type[k], thread_id);      \
+        tsum += phase_now() - t;                \
+}
+
+#define UNLOCK(k)                               \
+    {                                           \
+        unlock_slots(k, type[k], thread_id);    \
+    }
+#else
+#define LOCK(k)                                 \
+    {                                           \
+        t = phase_now();                        \
         my_lock(&Database[k].lock);             \
-        tsum += get_time() - t;                 \
+        tsum += phase_now() - t;                \
 }
 
 #define UNLOCK(k)                               \
     {                                           \
         my_unlock(&Database[k].lock);           \
     }
+#endif
 
 inline static void my_lock(bool *ptr) {
     for (;;) {
@@ -92,23 +195,209 @@ inline static void my_unlock(bool *ptr) {
     __atomic_store_n(ptr, false, __ATOMIC_RELEASE);
 }
 
+#if DELTA == 2
+static void lock_slots(int k, TYPE type, int thread_id)
+{
+    if (type & DELTA_UPDATE) {
+        my_lock(&Slot[k][thread_id].d.lock);
+        return;
+    }
+    my_lock(&Database[k].lock);
+    for (int i=0; i<NUM_THREADS; i++) {
+        my_lock(&Slot[k][i].d.lock);
+    }
+}
+
+static void unlock_slots(int k, TYPE type, int thread_id)
+{
+    if (type & DELTA_UPDATE) {
+        my_unlock(&Slot[k][thread_id].d.lock);
+        return;
+    }
+    for (int i=0; i<NUM_THREADS; i++) {
+        my_unlock(&Slot[k][i].d.lock);
+    }
+    my_unlock(&Database[k].lock);
+}
+#endif
+
+// value, tid and lock state of record k as seen by a reader; with per-thread
+// slots the slots are merged into the value, and the tid changes whenever
+// the record or one of its slots is written
+static inline int record_val(int k)
+{
+    int val = Database[k].val;
+#if DELTA == 2
+    for (int i=0; i<NUM_THREADS; i++) {
+        val = APPLY_DELTA(val, Slot[k][i].d.val);
+    }
+#endif
+    return val;
+}
+
+static inline int record_tid(int k)
+{
+    int tid = Database[k].tid;
+#if DELTA == 2
+    for (int i=0; i<NUM_THREADS; i++) {
+        tid += Slot[k][i].d.tid;
+    }
+#endif
+    return tid;
+}
+
+static inline bool record_locked(int k)
+{
+#if DELTA == 2
+    for (int i=0; i<NUM_THREADS; i++) {
+        if (Slot[k][i].d.lock) return true;
+    }
+#endif
+    return Database[k].lock;
+}
+
+#if VALIDATE_SIMD
+// Database[] as ints: record k is at k*DATA_INTS, its tid at TID_INT and its
+// lock in the low byte of LOCK_INT (the padding after it is never written)
+#define DATA_INTS (int)(sizeof(DATA)/sizeof(int))
+#define TID_INT   (int)(offsetof(DATA, tid)/sizeof(int))
+#define LOCK_INT  (int)(offsetof(DATA, lock)/sizeof(int))
+_Static_assert(sizeof(DATA) % sizeof(int) == 0 && offsetof(DATA, lock) % sizeof(int) == 0,
+               "DATA is not a whole number of ints");
+
+// the n reads of key[] saw tid[]; ronly[i] is -1 if key[i] is read only, so
+// that it must not be locked by another transaction, 0 otherwise
+static bool validate_reads(const int *key, const int *tid, const int *ronly, int n)
+{
+    int i = 0;
+
+#if defined(__AVX512F__)
+    const int *base = (const int*)Database;
+    const __m512i stride = _mm512_set1_epi32(DATA_INTS);
+    const __m512i byte = _mm512_set1_epi32(0xff);
+    for (; i<n; i+=16) {
+        __mmask16 m = (n-i >= 16) ? 0xffff : (__mmask16)((1u << (n-i)) - 1);
+        __m512i idx = _mm512_mullo_epi32(_mm512_maskz_loadu_epi32(m, key+i), stride);
+        __m512i t = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx, base+TID_INT, 4);
+        __m512i l = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx, base+LOCK_INT, 4);
+        l = _mm512_and_si512(l, byte);
+        if (_mm512_mask_cmpneq_epi32_mask(m, t, _mm512_maskz_loadu_epi32(m, tid+i)) ||
+            _mm512_mask_test_epi32_mask(m, l, _mm512_maskz_loadu_epi32(m, ronly+i))) {
+            return false;
+        }
+    }
+#elif defined(__AVX2__)
+    const int *base = (const int*)Database;
+    const __m256i stride = _mm256_set1_epi32(DATA_INTS);
+    const __m256i byte = _mm256_set1_epi32(0xff);
+    for (; i+8<=n; i+=8) {
+        __m256i idx = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(key+i)), stride);
+        __m256i t = _mm256_i32gather_epi32(base+TID_INT, idx, 4);
+        __m256i l = _mm256_and_si256(_mm256_i32gather_epi32(base+LOCK_INT, idx, 4), byte);
+        __m256i bad = _mm256_or_si256(
+            _mm256_xor_si256(t, _mm256_loadu_si256((const __m256i*)(tid+i))),
+            _mm256_and_si256(l, _mm256_loadu_si256((const __m256i*)(ronly+i))));
+        if (!_mm256_testz_si256(bad, bad)) return false;
+    }
+#endif
+    for (; i<n; i++) {
+        if (Database[key[i]].tid != tid[i] || (ronly[i] && Database[key[i]].lock)) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+#ifdef MP_PERCENT
+// a random key of partition p (keys p, p+NUM_THREADS, ...)
+int partition_key(int p)
+{
+    int n = (NUM_DATA - p + NUM_THREADS - 1) / NUM_THREADS;
+    return p + NUM_THREADS * (int)(random()/(1.0+RAND_MAX) * n);
+}
+#endif
+
+#if REPAIR
+// Re-read the keys whose tid changed and redo the operations that depend on
+// them.  In this workload a value depends only on the read of its own key,
+// so the other keys keep their values.  Fails if a read-only key is locked
+// by another transaction: waiting for it while holding the write set could
+// deadlock.
+static bool repair(TYPE *type, int *val, int *tid, XACT *xact)
+{
+    bool stale[NUM_DATA];
+
+    for (int k=0; k<NUM_DATA; k++) {
+        stale[k] = false;
+        if (!(type[k] & READ)) continue;
+        if (type[k] == READ && record_locked(k)) return false;
+        if (tid[k] != record_tid(k)) {
+            stale[k] = true;
+            val[k] = record_val(k);
+            tid[k] = record_tid(k);
+        }
+    }
+    for (int i=0; i<TX_LEN; i++) {
+        if (xact[i].type == READ && stale[xact[i].key]) {
+            val[xact[i].key] += 1;
+        }
+    }
+    return true;
+}
+#endif
+
+// Record why the validation failed: the first read whose tid changed, or
+// else the first read-only record locked by another transaction.  The
+// records are checked again, so one that changed back is not found (key -1).
+static void add_abort(CONFLICTS *c, const TYPE *type, const int *tid)
+{
+    for (int k=0; k<NUM_DATA; k++) {
+        if ((type[k] & READ) && tid[k] != record_tid(k)) {
+            conflict_add(c, CF_VALIDATE, k, record_tid(k));
+            return;
+        }
+    }
+    for (int k=0; k<NUM_DATA; k++) {
+        if (type[k] == READ && record_locked(k)) {
+            conflict_add(c, CF_LOCKED, k, record_tid(k));
+            return;
+        }
+    }
+    conflict_add(c, CF_VALIDATE, -1, -1);
+}
+
 void *worker(void *arg)
 {
     TYPE type[NUM_DATA];
     int  val[NUM_DATA];
     int  tid[NUM_DATA];
+#if VALIDATE_SIMD
+    // the read set packed: key, observed tid, read only (-1) or not (0)
+    int  rkey[NUM_DATA], rtid[NUM_DATA], ronly[NUM_DATA];
+    int  n_read;
+#endif
     XACT *xact = ((THREAD_ARGS*)arg)->xact;
     int thread_id = ((THREAD_ARGS*)arg)->id;
-    int t, tsum = 0;
+    uint64_t t, tsum = 0;
     int t_begin = get_time(), t_end;
     double t_elap, t_lock;
     int n_abort=0;
+    int n_repair=0;
     int n_commit=0;
     int commit_tid;
-    char stype[5] = "?rwm";
+    PHASES phases;
+    phase_init(&phases);
+    CONFLICTS conflicts;
+    conflict_init(&conflicts);
+#if HISTORY
+    HIST_BUF hist;
+    hist_init(&hist, thread_id);
+#endif
 
     for (int repeat=0; repeat < N_REPEAT; repeat++) {
         int n_retry=0;
+        PHASE(&phases, PH_OTHER);
 
         for (int k=0; k<NUM_DATA; k++) {
             type[k] = NONE;
@@ -120,18 +409,41 @@ void *worker(void *arg)
         for (int i=0; i<TX_LEN; i++) {
             type[xact[i].key] |= xact[i].type;
         }
+#if DELTA
+        // read-modify-write keys become delta updates
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] == (READ|WRITE)) type[k] = WRITE|DELTA_UPDATE;
+        }
+#endif
 
     retry:
+        PHASE(&phases, PH_READ);
+#if DELTA
+        // delta keys are not read, so start their deltas again from 0
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] & DELTA_UPDATE) val[k] = 0;
+        }
+#endif
 
+#if VALIDATE_SIMD
+        n_read = 0;
+#endif
         for (int k=0; k<NUM_DATA; k++) {
             // read data
             if (type[k] & READ) {
-                val[k] = Database[k].val;
-                tid[k] = Database[k].tid;
+                val[k] = record_val(k);
+                tid[k] = record_tid(k);
+#if VALIDATE_SIMD
+                rkey[n_read] = k;
+                rtid[n_read] = tid[k];
+                ronly[n_read] = (type[k] == READ) ? -1 : 0;
+                n_read++;
+#endif
             }
         }
 
         // modify
+        PHASE(&phases, PH_MODIFY);
         for (int i=0; i<TX_LEN; i++) {
             if (xact[i].type == READ) {
                 val[xact[i].key] += 1;
@@ -139,6 +451,7 @@ void *worker(void *arg)
         }
 
         // Phase 1 (lock)
+        PHASE(&phases, PH_LOCK);
         for (int k=0; k<NUM_DATA; k++) {
             // lock write set
             if (type[k] & WRITE) {
@@ -147,35 +460,59 @@ void *worker(void *arg)
         }
 
         // Phase 2 (validate)
+        PHASE(&phases, PH_VALIDATE);
+        bool valid;
+#if REPAIR
+        int n_repair_tx = 0;
+    validate:
+#endif
+#if VALIDATE_SIMD
+        valid = validate_reads(rkey, rtid, ronly, n_read);
+#else
+        valid = true;
         for (int k=0; k<NUM_DATA; k++) {
-            if ( ((type[k]&READ) && tid[k]!=Database[k].tid) ||
-                 ((type[k]==READ) && Database[k].lock) ) {
-                n_abort += 1;
-                n_retry += 1;
-                if (n_retry%1000==0) {
-                    printf("%d: n_retry=%d ",thread_id,n_retry);
-                    for (int j=0; j<NUM_DATA; j++) {
-                        printf("%d:%c%d%c ",
-                               j,
-                               stype[type[j]],
-                               (type[j]&READ)?Database[j].tid-tid[j]:0,
-                               (Database[j].lock) ? 'x' : '_');
-                    }
-                    printf("\n");
-                    fflush(stdout);
+            if ( ((type[k]&READ) && tid[k]!=record_tid(k)) ||
+                 ((type[k]==READ) && record_locked(k)) ) {
+                valid = false;
+                break;
+            }
+        }
+#endif
+        if (!valid) {
+#if REPAIR
+            if (n_repair_tx < REPAIR_MAX && repair(type, val, tid, xact)) {
+                n_repair_tx += 1;
+                n_repair += 1;
+#if VALIDATE_SIMD
+                for (int i=0; i<n_read; i++) {
+                    rtid[i] = tid[rkey[i]];
                 }
-                // unlock write set
-                for (int j=0; j<NUM_DATA; j++) {
-                    if (type[j] & WRITE) {
-                        UNLOCK(j);
-                    }
+#endif
+                goto validate;
+            }
+#endif
+            PHASE(&phases, PH_BACKOFF);
+            add_abort(&conflicts, type, tid);
+            n_abort += 1;
+            n_retry += 1;
+            if (n_retry%1000==0) {
+                printf("%d: n_retry=%d ",thread_id,n_retry);
+                conflict_print_last(&conflicts);
+                printf("\n");
+                fflush(stdout);
+            }
+            // unlock write set
+            for (int j=0; j<NUM_DATA; j++) {
+                if (type[j] & WRITE) {
+                    UNLOCK(j);
                 }
-                usleep(3);
-                goto retry;
             }
+            usleep(3);
+            goto retry;
         }
 
         // commit tid
+        PHASE(&phases, PH_WRITE);
         commit_tid = 0;
         for (int k=0; k<NUM_DATA; k++) {
             if (type[k] != NONE) {
@@ -185,6 +522,18 @@ void *worker(void *arg)
         }
         commit_tid++;
 
+#if HISTORY
+        // the reads are validated and the write set is locked
+        hist_begin(&hist, 0);
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] & READ) hist_read(&hist, k, tid[k]);
+            // a delta update reads the version it is applied to
+            if (type[k] & DELTA_UPDATE) hist_read(&hist, k, Database[k].tid);
+            if (type[k] & WRITE) hist_write(&hist, k, commit_tid);
+        }
+        hist_commit(&hist);
+#endif
+
 #if DEBUG
         for (int i=0; i<TX_LEN; i++) {
             printf(" %c%d",(xact[i].type==READ) ? 'r':'w', xact[i].key);
@@ -195,8 +544,30 @@ void *worker(void *arg)
         // Phase 3 (write)
         for (int k=0; k<NUM_DATA; k++) {
             if (type[k] & WRITE) {
+#if DELTA == 2
+                if (type[k] & DELTA_UPDATE) {
+                    DATA *d = &Slot[k][thread_id].d;
+                    d->val = APPLY_DELTA(d->val, val[k]);
+                    d->tid += 1;
+                } else {
+                    Database[k].val = val[k];
+                    Database[k].tid = commit_tid;
+                    for (int i=0; i<NUM_THREADS; i++) {
+                        Slot[k][i].d.val = DELTA_IDENTITY;
+                        Slot[k][i].d.tid += 1;
+                    }
+                }
+#elif DELTA
+                if (type[k] & DELTA_UPDATE) {
+                    Database[k].val = APPLY_DELTA(Database[k].val, val[k]);
+                } else {
+                    Database[k].val = val[k];
+                }
+                Database[k].tid = commit_tid;
+#else
                 Database[k].val = val[k];
                 Database[k].tid = commit_tid;
+#endif
                 UNLOCK(k);
             }
 #if DEBUG
@@ -209,16 +580,21 @@ void *worker(void *arg)
         xact += TX_LEN;
     }
     t_end = get_time();
+#if HISTORY
+    hist_finish(&hist);
+#endif
     t_elap = (t_end-t_begin)*1e-6;
-    t_lock = tsum*1e-6;
-    printf("%d: time: elap=%f lock=%f lock_ratio=%f n_abort=%d n_commit=%d\n",
-           thread_id,t_elap,t_lock,t_lock/t_elap,n_abort,n_commit);
+    t_lock = tsum/phase_tsc_hz();
+    printf("%d: time: elap=%f lock=%f lock_ratio=%f n_abort=%d n_repair=%d n_commit=%d\n",
+           thread_id,t_elap,t_lock,t_lock/t_elap,n_abort,n_repair,n_commit);
+    phase_report(&phases, thread_id, n_commit);
+    conflict_report(&conflicts, thread_id);
 
     return NULL;
 }
 
 
-int main(){
+int main(int argc, char *argv[]){
     int i, j, sum;
     THREAD_ARGS thread_args[NUM_THREADS];
 
@@ -227,31 +603,69 @@ int main(){
         Database[i].val = 0;
         Database[i].tid = 0;
         Database[i].lock = false;
+#if DELTA == 2
+        for (j=0; j<NUM_THREADS; j++) {
+            Slot[i][j].d.val = DELTA_IDENTITY;
+            Slot[i][j].d.tid = 0;
+            Slot[i][j].d.lock = false;
+        }
+#endif
     }
 
     // Create Transaction
     sum = 0;
-    for(i=0; i<NUM_THREADS; i++){
+    if (argc > 1) {
+        // replay the trace argv[1] instead of generating the transactions
+        const TRACE_HEADER *h = trace_open(argv[1], NUM_THREADS, TX_LEN, N_REPEAT, NUM_DATA);
+        for (i=0; i<NUM_THREADS; i++) {
+            thread_args[i].xact = TRACE_XACT(h, i);
+            thread_args[i].id = i;
+        }
+        sum = trace_n_read(h, NUM_THREADS, N_REPEAT);
+    } else {
+        for(i=0; i<NUM_THREADS; i++){
 #if DEBUG
-        printf("thread%d:",i);
+            printf("thread%d:",i);
 #endif
-        for(j=0; j<TX_LEN*N_REPEAT; j++){
-            xact[j][i].type = (random()&1) ? READ : WRITE;
-            xact[j][i].key = (int)(random()/(1.0+RAND_MAX) * NUM_DATA);
+#ifdef MP_PERCENT
+            // thread i's transactions one after another in the same storage
+            XACT *x = (XACT*)xact + (long)i*TX_LEN*N_REPEAT;
+            for(j=0; j<TX_LEN*N_REPEAT; j+=TX_LEN){
+                bool multi = (random()%100 < MP_PERCENT);
+                for (int k=j; k<j+TX_LEN; k++) {
+                    x[k].type = (random()&1) ? READ : WRITE;
+                    x[k].key = multi ? (int)(random()/(1.0+RAND_MAX) * NUM_DATA)
+                                     : partition_key(i);
+                    if (x[k].type==READ) {
+                        sum += 1;
+                    }
+                }
+            }
+            thread_args[i].xact = x;
+            thread_args[i].id = i;
+#else
+            for(j=0; j<TX_LEN*N_REPEAT; j++){
+                xact[j][i].type = (random()&1) ? READ : WRITE;
+                xact[j][i].key = (int)(random()/(1.0+RAND_MAX) * NUM_DATA);
 #if DEBUG
-            printf(" %c%d",(xact[j][i].type==READ) ? 'r':'w', xact[j][i].key);
+                printf(" %c%d",(xact[j][i].type==READ) ? 'r':'w', xact[j][i].key);
 #endif
-            if (xact[j][i].type==READ) {
-                sum += 1;
+                if (xact[j][i].type==READ) {
+                    sum += 1;
+                }
+                thread_args[i].xact = xact[i];
+                thread_args[i].id = i;
             }
-            thread_args[i].xact = xact[i];
-            thread_args[i].id = i;
-        }
+#endif
 #if DEBUG
-        printf("\n");
+            printf("\n");
 #endif
+        }
     }
     printf("# of READ=%d\n",sum);
+#if HISTORY
+    hist_open();
+#endif
     init_time();
 
     // Start threads
@@ -263,12 +677,18 @@ int main(){
     for(i=0; i<NUM_THREADS; i++) {
         pthread_join(threads[i], NULL);
     }
+    phase_report_total((long)N_REPEAT*NUM_THREADS);
+    conflict_report_total();
+#if HISTORY
+    hist_close();
+    printf("history: %s\n", HISTORY_FILE);
+#endif
 
     // Print result
     sum = 0;
     for (i=0; i<NUM_DATA; i++) {
-        printf("%d ",Database[i].val);
-        sum += Database[i].val;
+        printf("%d ",record_val(i));
+        sum += record_val(i);
     }
     printf("\nsum=%d\n",sum);
 
@@ -0,0 +1,421 @@
+/* gcc ex1.c -o ex1 -g -W -Wall -lpthread -std=gnu99 */
+
+/*
+ * TicToc: the same record layout and worker loop as silo/ex2.c, but the
+ * commit timestamp is computed from the wts/rts of the records the
+ * transaction touched instead of from a global counter.  A read stays
+ * valid as long as its [wts,rts] range can be extended to cover the
+ * commit timestamp.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "../trace/trace.h"
+#include "../conflict/conflict.h"
+
+#define DEBUG 0
+
+// 1: cycles per phase (read, modify, lock, validate, write, backoff),
+// 2: also perf counters per phase (see phase/phase.h)
+#ifndef PHASE_STATS
+#define PHASE_STATS 0
+#endif
+#include "../phase/phase.h"
+
+// 1: record the committed transactions to HISTORY_FILE for history/check
+//    (timestamp and write version: commit_ts, read version: the wts seen)
+#ifndef HISTORY
+#define HISTORY 0
+#endif
+#if HISTORY
+#include "../history/history.h"
+#endif
+
+#if DEBUG
+#define NUM_THREADS 4
+#define NUM_DATA 5
+#define TX_LEN 5
+#define N_REPEAT (12/NUM_THREADS)
+#else
+#define NUM_THREADS 4
+#define NUM_DATA 10
+//#define NUM_DATA 30
+#define TX_LEN 30
+//#define TX_LEN 10
+#define N_REPEAT (400000/NUM_THREADS)
+//#define N_REPEAT (4000/NUM_THREADS)
+#endif
+
+typedef struct _DATA {
+    int val;
+    int wts;    // commit timestamp of the writer of val
+    int rts;    // val is known to be valid up to rts
+    bool lock;
+} DATA;
+
+typedef enum {NONE=0, READ=1, WRITE=2} TYPE;
+
+typedef struct _XACT {
+    int key;
+    TYPE type;
+} XACT;
+
+typedef struct _THREAD_ARGS {
+    int   id;
+    XACT *xact;
+} THREAD_ARGS;
+
+DATA Database[NUM_DATA];
+pthread_t threads[NUM_THREADS];
+XACT xact[TX_LEN*N_REPEAT][NUM_THREADS];
+
+static struct timespec start_time;
+
+void init_time()
+{
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+int get_time()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - start_time.tv_sec)*1000000 + t.tv_nsec/1000;
+}
+
+#define LOCK(k)                                 \
+    {                                           \
+        t = phase_now();                        \
+        my_lock(&Database[k].lock);             \
+        tsum += phase_now() - t;                \
+}
+
+#define UNLOCK(k)                               \
+    {                                           \
+        my_unlock(&Database[k].lock);           \
+    }
+
+inline static void my_lock(bool *ptr) {
+    for (;;) {
+        bool expected=false;
+        bool desired=true;
+        if (*ptr == expected) {
+            if (__atomic_compare_exchange_n(ptr, &expected, desired, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return;
+            }
+        }
+        usleep(1);
+    }
+}
+
+inline static bool my_trylock(bool *ptr) {
+    bool expected=false;
+    return __atomic_compare_exchange_n(ptr, &expected, true, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+inline static void my_unlock(bool *ptr) {
+    __atomic_store_n(ptr, false, __ATOMIC_RELEASE);
+}
+
+// Take a consistent snapshot of (val, wts, rts); retry while a writer
+// holds the record or wts moved underneath us.
+inline static void read_record(int k, int *val, int *wts, int *rts) {
+    for (;;) {
+        if (__atomic_load_n(&Database[k].lock, __ATOMIC_ACQUIRE)) {
+            usleep(1);
+            continue;
+        }
+        int w = __atomic_load_n(&Database[k].wts, __ATOMIC_ACQUIRE);
+        *val  = __atomic_load_n(&Database[k].val, __ATOMIC_ACQUIRE);
+        *rts  = __atomic_load_n(&Database[k].rts, __ATOMIC_ACQUIRE);
+        if (!__atomic_load_n(&Database[k].lock, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&Database[k].wts, __ATOMIC_ACQUIRE) == w) {
+            *wts = w;
+            return;
+        }
+    }
+}
+
+// Validate a read-only record at commit_ts.  The read stays valid if wts
+// is unchanged and rts already covers commit_ts; otherwise rts is
+// extended under the record lock.  Another validator holds that lock
+// only for its own extension, so retry the try-lock EXTEND_TRIES times
+// before blaming a writer.  Returns the conflict cause, or -1 if valid.
+#define EXTEND_TRIES 4
+inline static int validate_read(int k, int wts, int commit_ts, int *n_extend) {
+    for (int n=0; n<EXTEND_TRIES; n++) {
+        if (__atomic_load_n(&Database[k].wts, __ATOMIC_ACQUIRE) != wts) {
+            return CF_VALIDATE;
+        }
+        // a writer stores rts before wts, so an rts seen with the lock
+        // held may already belong to the next version
+        int r = __atomic_load_n(&Database[k].rts, __ATOMIC_ACQUIRE);
+        if (r >= commit_ts &&
+            !__atomic_load_n(&Database[k].lock, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&Database[k].wts, __ATOMIC_ACQUIRE) == wts) {
+            return -1;
+        }
+        if (my_trylock(&Database[k].lock)) {
+            int cause = -1;
+            if (Database[k].wts != wts) {
+                cause = CF_VALIDATE;
+            } else if (Database[k].rts < commit_ts) {
+                __atomic_store_n(&Database[k].rts, commit_ts, __ATOMIC_RELEASE);
+                *n_extend += 1;
+            }
+            UNLOCK(k);
+            return cause;
+        }
+        usleep(1);
+    }
+    return CF_LOCKED;
+}
+
+void *worker(void *arg)
+{
+    TYPE type[NUM_DATA];
+    int  val[NUM_DATA];
+    int  wts[NUM_DATA];
+    int  rts[NUM_DATA];
+    XACT *xact = ((THREAD_ARGS*)arg)->xact;
+    int thread_id = ((THREAD_ARGS*)arg)->id;
+    uint64_t t, tsum = 0;
+    int t_begin = get_time(), t_end;
+    double t_elap, t_lock;
+    int n_abort=0;
+    int n_extend=0;
+    int n_commit=0;
+    int commit_ts;
+    PHASES phases;
+    phase_init(&phases);
+    CONFLICTS conflicts;
+    conflict_init(&conflicts);
+#if HISTORY
+    HIST_BUF hist;
+    hist_init(&hist, thread_id);
+#endif
+
+    for (int repeat=0; repeat < N_REPEAT; repeat++) {
+        int n_retry=0;
+        PHASE(&phases, PH_OTHER);
+
+        for (int k=0; k<NUM_DATA; k++) {
+            type[k] = NONE;
+            val[k] = 0;
+            wts[k] = 0;
+            rts[k] = 0;
+        }
+
+        // get Read/Write set
+        for (int i=0; i<TX_LEN; i++) {
+            type[xact[i].key] |= xact[i].type;
+        }
+
+    retry:
+        PHASE(&phases, PH_READ);
+
+        for (int k=0; k<NUM_DATA; k++) {
+            // read data
+            if (type[k] & READ) {
+                read_record(k, &val[k], &wts[k], &rts[k]);
+            }
+        }
+
+        // modify
+        PHASE(&phases, PH_MODIFY);
+        for (int i=0; i<TX_LEN; i++) {
+            if (xact[i].type == READ) {
+                val[xact[i].key] += 1;
+            }
+        }
+
+        // Phase 1 (lock)
+        PHASE(&phases, PH_LOCK);
+        for (int k=0; k<NUM_DATA; k++) {
+            // lock write set
+            if (type[k] & WRITE) {
+                LOCK(k);
+            }
+        }
+
+        // commit ts: after every read version, and after every read of
+        // the records we are about to overwrite
+        PHASE(&phases, PH_VALIDATE);
+        commit_ts = 0;
+        for (int k=0; k<NUM_DATA; k++) {
+            if ((type[k] & READ) && wts[k] > commit_ts) {
+                commit_ts = wts[k];
+            }
+            if ((type[k] & WRITE) && Database[k].rts + 1 > commit_ts) {
+                commit_ts = Database[k].rts + 1;
+            }
+        }
+
+        // Phase 2 (validate)
+        for (int k=0; k<NUM_DATA; k++) {
+            int cause = -1;     // -1: valid
+            if (!(type[k] & READ) || rts[k] >= commit_ts) {
+                continue;
+            }
+            if (type[k] & WRITE) {
+                // we hold the lock; only the version has to match
+                if (Database[k].wts != wts[k]) cause = CF_VALIDATE;
+            } else {
+                cause = validate_read(k, wts[k], commit_ts, &n_extend);
+            }
+            if (cause >= 0) {
+                PHASE(&phases, PH_BACKOFF);
+                conflict_add(&conflicts, cause, k, Database[k].wts);
+                n_abort += 1;
+                n_retry += 1;
+                if (n_retry%1000==0) {
+                    printf("%d: n_retry=%d ",thread_id,n_retry);
+                    conflict_print_last(&conflicts);
+                    printf("\n");
+                    fflush(stdout);
+                }
+                // unlock write set
+                for (int j=0; j<NUM_DATA; j++) {
+                    if (type[j] & WRITE) {
+                        UNLOCK(j);
+                    }
+                }
+                usleep(3);
+                goto retry;
+            }
+        }
+
+#if HISTORY
+        // every read is valid at commit_ts and the write set is locked
+        hist_begin(&hist, commit_ts);
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] & READ) hist_read(&hist, k, wts[k]);
+            if (type[k] & WRITE) hist_write(&hist, k, commit_ts);
+        }
+        hist_commit(&hist);
+#endif
+
+#if DEBUG
+        for (int i=0; i<TX_LEN; i++) {
+            printf(" %c%d",(xact[i].type==READ) ? 'r':'w', xact[i].key);
+        }
+        printf(" commit_ts=%d\n",commit_ts);
+#endif
+
+        // Phase 3 (write)
+        PHASE(&phases, PH_WRITE);
+        for (int k=0; k<NUM_DATA; k++) {
+            if (type[k] & WRITE) {
+                __atomic_store_n(&Database[k].val, val[k], __ATOMIC_RELEASE);
+                __atomic_store_n(&Database[k].rts, commit_ts, __ATOMIC_RELEASE);
+                __atomic_store_n(&Database[k].wts, commit_ts, __ATOMIC_RELEASE);
+                UNLOCK(k);
+            }
+#if DEBUG
+            printf("value[%d]=%d Database[%d].val=%d wts=%d rts=%d\n",
+                   k,val[k],k,Database[k].val,wts[k],rts[k]);
+#endif
+        }
+
+        n_commit += 1;
+        xact += TX_LEN;
+    }
+    t_end = get_time();
+#if HISTORY
+    hist_finish(&hist);
+#endif
+    t_elap = (t_end-t_begin)*1e-6;
+    t_lock = tsum/phase_tsc_hz();
+    printf("%d: time: elap=%f lock=%f lock_ratio=%f n_abort=%d n_extend=%d n_commit=%d\n",
+           thread_id,t_elap,t_lock,t_lock/t_elap,n_abort,n_extend,n_commit);
+    phase_report(&phases, thread_id, n_commit);
+    conflict_report(&conflicts, thread_id);
+
+    return NULL;
+}
+
+
+int main(int argc, char *argv[]){
+    int i, j, sum;
+    THREAD_ARGS thread_args[NUM_THREADS];
+
+    // Initialize Database
+    for (i=0; i<NUM_DATA; i++) {
+        Database[i].val = 0;
+        Database[i].wts = 0;
+        Database[i].rts = 0;
+        Database[i].lock = false;
+    }
+
+    // Create Transaction
+    sum = 0;
+    if (argc > 1) {
+        // replay the trace argv[1] instead of generating the transactions
+        const TRACE_HEADER *h = trace_open(argv[1], NUM_THREADS, TX_LEN, N_REPEAT, NUM_DATA);
+        for (i=0; i<NUM_THREADS; i++) {
+            thread_args[i].xact = TRACE_XACT(h, i);
+            thread_args[i].id = i;
+        }
+        sum = trace_n_read(h, NUM_THREADS, N_REPEAT);
+    } else {
+        for(i=0; i<NUM_THREADS; i++){
+#if DEBUG
+            printf("thread%d:",i);
+#endif
+            for(j=0; j<TX_LEN*N_REPEAT; j++){
+                xact[j][i].type = (random()&1) ? READ : WRITE;
+                xact[j][i].key = (int)(random()/(1.0+RAND_MAX) * NUM_DATA);
+#if DEBUG
+                printf(" %c%d",(xact[j][i].type==READ) ? 'r':'w', xact[j][i].key);
+#endif
+                if (xact[j][i].type==READ) {
+                    sum += 1;
+                }
+                thread_args[i].xact = xact[i];
+                thread_args[i].id = i;
+            }
+#if DEBUG
+            printf("\n");
+#endif
+        }
+    }
+    printf("# of READ=%d\n",sum);
+#if HISTORY
+    hist_open();
+#endif
+    init_time();
+
+    // Start threads
+    for(i=0; i<NUM_THREADS; i++) {
+        pthread_create(&threads[i], NULL, worker, &thread_args[i]);
+    }
+
+    // Join threads
+    for(i=0; i<NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    phase_report_total((long)N_REPEAT*NUM_THREADS);
+    conflict_report_total();
+#if HISTORY
+    hist_close();
+    printf("history: %s\n", HISTORY_FILE);
+#endif
+
+    // Print result
+    sum = 0;
+    for (i=0; i<NUM_DATA; i++) {
+        printf("%d ",Database[i].val);
+        sum += Database[i].val;
+    }
+    printf("\nsum=%d\n",sum);
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+/* gcc import.c -o import -g -W -Wall -std=gnu99 */
+
+// Import a text log of transactions into a trace:
+//   ./import out.trace [tx_len] < log
+// One transaction per line: the thread (or client) number, then its ops
+// as r<key> or w<key>, the format the engines print with DEBUG:
+//   0 r3 w5 r3
+//   1 w2
+// Thread numbers are renumbered 0, 1, ... in order of appearance.  The
+// transactions are padded to tx_len ops (default: the longest one) and
+// the threads to the same number of transactions with empty ones.
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+#define MAX_THREADS 1024
+
+typedef struct _STREAM {
+    long id;          // thread number in the log
+    TRACE_OP *ops;    // tx_begin[i]: index of the first op of transaction i
+    long n_ops, cap_ops;
+    long *tx_begin;
+    long n_tx, cap_tx;
+} STREAM;
+
+static void *grow(void *p, long *cap, long n, size_t size)
+{
+    if (n < *cap) return p;
+    *cap = (*cap == 0) ? 1024 : *cap * 2;
+    p = realloc(p, *cap * size);
+    if (p == NULL) {
+        perror("realloc");
+        exit(1);
+    }
+    return p;
+}
+
+int main(int argc, char *argv[])
+{
+    static STREAM s[MAX_THREADS];
+    int n_threads = 0;
+    int tx_len = (argc > 2) ? atoi(argv[2]) : 0;
+    int max_len = 0, max_tx = 0, num_data = 0;
+    char *line = NULL;
+    size_t len = 0;
+    long lineno = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s out.trace [tx_len] < log\n", argv[0]);
+        return 1;
+    }
+    while (getline(&line, &len, stdin) > 0) {
+        char *p = line, *q;
+        lineno++;
+        long id = strtol(p, &q, 10);
+        if (q == p) continue;  // blank or not a transaction
+        int t;
+        for (t=0; t<n_threads && s[t].id != id; t++) {}
+        if (t == n_threads) {
+            if (n_threads == MAX_THREADS) {
+                fprintf(stderr, "line %ld: more than %d threads\n", lineno, MAX_THREADS);
+                return 1;
+            }
+            s[n_threads++].id = id;
+        }
+        STREAM *st = &s[t];
+        st->tx_begin = grow(st->tx_begin, &st->cap_tx, st->n_tx, sizeof(long));
+        st->tx_begin[st->n_tx++] = st->n_ops;
+        for (p = q; *p; ) {
+            while (isspace((unsigned char)*p)) p++;
+            if (*p == '\0') break;
+            if ((*p != 'r' && *p != 'w') || !isdigit((unsigned char)p[1])) {
+                fprintf(stderr, "line %ld: bad op '%s'\n", lineno, p);
+                return 1;
+            }
+            st->ops = grow(st->ops, &st->cap_ops, st->n_ops, sizeof(TRACE_OP));
+            st->ops[st->n_ops].type = (*p == 'r') ? 1 : 2;
+            errno = 0;
+            long key = strtol(p+1, &q, 10);
+            // num_data = key+1 has to fit in the header's int32
+            if (errno == ERANGE || key >= INT32_MAX) {
+                fprintf(stderr, "line %ld: key out of range '%.*s'\n", lineno, (int)(q-p), p);
+                return 1;
+            }
+            p = q;
+            st->ops[st->n_ops].key = key;
+            if (key >= num_data) num_data = key + 1;
+            st->n_ops++;
+        }
+        int n = st->n_ops - st->tx_begin[st->n_tx-1];
+        if (n > max_len) max_len = n;
+        if (st->n_tx > max_tx) max_tx = st->n_tx;
+    }
+    if (tx_len == 0) tx_len = max_len;
+    if (max_len > tx_len) {
+        fprintf(stderr, "a transaction has %d ops, more than tx_len=%d\n", max_len, tx_len);
+        return 1;
+    }
+
+    // pad every transaction to tx_len and every thread to max_tx
+    TRACE_OP **ops = malloc(sizeof(TRACE_OP*) * n_threads);
+    for (int t=0; t<n_threads; t++) {
+        ops[t] = calloc((size_t)max_tx * tx_len, sizeof(TRACE_OP));
+        for (long i=0; i<s[t].n_tx; i++) {
+            long end = (i+1 < s[t].n_tx) ? s[t].tx_begin[i+1] : s[t].n_ops;
+            memcpy(&ops[t][i*tx_len], &s[t].ops[s[t].tx_begin[i]],
+                   (end - s[t].tx_begin[i]) * sizeof(TRACE_OP));
+        }
+    }
+    trace_write(argv[1], n_threads, tx_len, max_tx, num_data, ops);
+    printf("threads=%d tx_len=%d n_tx=%d num_data=%d\n", n_threads, tx_len, max_tx, num_data);
+    return 0;
+}
@@ -0,0 +1,53 @@
+/* gcc record.c -o record -g -W -Wall -std=gnu99 */
+
+// Record the workload generator of twopl, occ, silo, tictoc and calvin into
+// a trace:
+//   ./record out.trace n_threads tx_len n_tx num_data [seed]
+// Every op is a READ or a WRITE with equal probability on a uniform key.
+// As in main() of those engines, the ops are generated with random() into
+// xact[n_tx*tx_len][n_threads] one thread (column) after another, and
+// thread t runs n_tx*tx_len ops from row t, so without a seed the trace
+// replays their default workload.  hybrid (hot keys), hstore and the
+// MP_PERCENT builds (partitioned keys), and mvto and mvocc (std::mt19937)
+// generate their workloads differently.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "usage: %s out.trace n_threads tx_len n_tx num_data [seed]\n", prog);
+    fprintf(stderr, "  all counts > 0, n_tx*tx_len >= n_threads\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 6) usage(argv[0]);
+    int n_threads = atoi(argv[2]);
+    int tx_len = atoi(argv[3]);
+    int n_tx = atoi(argv[4]);
+    int num_data = atoi(argv[5]);
+    if (n_threads <= 0 || tx_len <= 0 || n_tx <= 0 || num_data <= 0) usage(argv[0]);
+    if (argc > 6) srandom(atoi(argv[6]));
+
+    long n_ops = (long)n_tx * tx_len;
+    // thread t's stream starts at xact + t*n_threads and is n_ops long, so
+    // the last one stays inside the n_ops*n_threads buffer only if
+    // n_ops >= n_threads
+    if (n_ops < n_threads) usage(argv[0]);
+    TRACE_OP *xact = malloc(sizeof(TRACE_OP) * n_ops * n_threads);
+    TRACE_OP **ops = malloc(sizeof(TRACE_OP*) * n_threads);
+    for (int t=0; t<n_threads; t++) {
+        for (long j=0; j<n_ops; j++) {
+            xact[j*n_threads + t].type = (random()&1) ? 1 : 2;
+            xact[j*n_threads + t].key = (int)(random()/(1.0+RAND_MAX) * num_data);
+        }
+    }
+    for (int t=0; t<n_threads; t++) {
+        ops[t] = xact + (long)t*n_threads;
+    }
+    trace_write(argv[1], n_threads, tx_len, n_tx, num_data, ops);
+    return 0;
+}
@@ -0,0 +1,156 @@
+// Binary workload trace, shared by the engines (C and C++).
+//
+//   TRACE_HEADER | ops of thread 0 | ops of thread 1 | ...
+//
+// Each thread's stream is n_tx transactions of tx_len ops.  An op is
+// {int32 key, int32 type} with the layout of the engines' XACT (type
+// 1: READ, 2: WRITE), so an engine maps the file and runs thread i
+// directly on trace_ops(h, i) without copying or parsing.  Transactions
+// shorter than tx_len are padded with {0, 0} ops (NONE), which the
+// engines skip.
+//
+// An engine replays a trace given as its first argument:
+//   ./ex1 workload.trace
+// The trace must have been written for the engine's TX_LEN and at least
+// its NUM_THREADS, N_REPEAT and keys below NUM_DATA (trace/record,
+// trace/import).
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRACE_MAGIC "TXTRACE1"
+
+typedef struct _TRACE_HEADER {
+    char magic[8];
+    int32_t n_threads;
+    int32_t tx_len;      // ops per transaction
+    int32_t n_tx;        // transactions per thread
+    int32_t num_data;    // keys are in [0, num_data)
+    int64_t n_read;      // READ ops in the whole trace (see trace_n_read())
+} TRACE_HEADER;
+
+typedef struct _TRACE_OP {
+    int32_t key;
+    int32_t type;
+} TRACE_OP;
+
+static inline TRACE_OP *trace_ops(const TRACE_HEADER *h, int thread)
+{
+    return (TRACE_OP*)(h + 1) + (size_t)thread * h->n_tx * h->tx_len;
+}
+
+// thread i's ops as the engine's XACT array (XACT as in the engines)
+#define TRACE_XACT(h, i) \
+    (sizeof(XACT) == sizeof(TRACE_OP) ? (XACT*)trace_ops(h, i) : (abort(), (XACT*)NULL))
+
+// Map path and check that it can drive an engine with the given
+// parameters and that every op is in range; exits on error.  The mapping is private and writable, so
+// the ops can be used as a (non-const) XACT array.
+static inline const TRACE_HEADER *trace_open(const char *path, int n_threads,
+                                             int tx_len, int n_tx, int num_data)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+    if ((size_t)st.st_size < sizeof(TRACE_HEADER)) {
+        fprintf(stderr, "%s: not a trace\n", path);
+        exit(1);
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(path);
+        exit(1);
+    }
+    const TRACE_HEADER *h = (const TRACE_HEADER*)p;
+    if (memcmp(h->magic, TRACE_MAGIC, 8) != 0 ||
+        (size_t)st.st_size < sizeof(TRACE_HEADER) +
+        (size_t)h->n_threads * h->n_tx * h->tx_len * sizeof(TRACE_OP)) {
+        fprintf(stderr, "%s: not a trace or truncated\n", path);
+        exit(1);
+    }
+    if (h->n_threads < n_threads || h->tx_len != tx_len || h->n_tx < n_tx ||
+        h->num_data > num_data) {
+        fprintf(stderr, "%s: threads=%d tx_len=%d n_tx=%d num_data=%d, "
+                "need threads>=%d tx_len=%d n_tx>=%d num_data<=%d\n",
+                path, h->n_threads, h->tx_len, h->n_tx, h->num_data,
+                n_threads, tx_len, n_tx, num_data);
+        exit(1);
+    }
+    // the engines index Database[] by key and switch on type without
+    // checking, so a bad op must not get past here
+    for (int t=0; t<h->n_threads; t++) {
+        const TRACE_OP *op = trace_ops(h, t);
+        for (long i=0; i<(long)h->n_tx*h->tx_len; i++) {
+            if (op[i].key < 0 || op[i].key >= h->num_data ||
+                op[i].type < 0 || op[i].type > 2) {
+                fprintf(stderr, "%s: thread %d op %ld: key=%d type=%d, "
+                        "need 0<=key<%d and type 0, 1 or 2\n",
+                        path, t, i, op[i].key, op[i].type, h->num_data);
+                exit(1);
+            }
+        }
+    }
+    // every thread reads its stream once from the beginning
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    return h;
+}
+
+// READ ops in the first n_tx transactions of the first n_threads streams,
+// the part of the trace an engine runs (h->n_read counts the whole trace)
+static inline long trace_n_read(const TRACE_HEADER *h, int n_threads, int n_tx)
+{
+    long n = 0;
+    for (int t=0; t<n_threads; t++) {
+        const TRACE_OP *op = trace_ops(h, t);
+        for (long i=0; i<(long)n_tx*h->tx_len; i++) {
+            if (op[i].type == 1) n++;
+        }
+    }
+    return n;
+}
+
+// Write a trace whose ops are ops[thread][tx*tx_len + i]; exits on error.
+static inline void trace_write(const char *path, int n_threads, int tx_len, int n_tx,
+                               int num_data, TRACE_OP *const *ops)
+{
+    TRACE_HEADER h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRACE_MAGIC, 8);
+    h.n_threads = n_threads;
+    h.tx_len = tx_len;
+    h.n_tx = n_tx;
+    h.num_data = num_data;
+    for (int t=0; t<n_threads; t++) {
+        for (long i=0; i<(long)n_tx*tx_len; i++) {
+            if (ops[t][i].type == 1) h.n_read++;
+        }
+    }
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fwrite(&h, sizeof(h), 1, f);
+    for (int t=0; t<n_threads; t++) {
+        fwrite(ops[t], sizeof(TRACE_OP), (size_t)n_tx*tx_len, f);
+    }
+    if (fclose(f) != 0) {
+        perror(path);
+        exit(1);
+    }
+}
+
+#endif // TRACE_H
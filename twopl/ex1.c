@@ -3,30 +3,99 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
+#include "../trace/trace.h"
 
 #define NUM_THREADS 4
 #define NUM_DATA 10
 #define TX_LEN 30
 #define N_REPEAT (400000/NUM_THREADS)
 
+// partitioned workload of hstore/ex1.c with MP_PERCENT% multi-partition
+// transactions instead of uniform keys
+//#define MP_PERCENT 10
+
+// 1: a key that is read and written is updated by a commutative delta under
+//    an increment lock, which is shared by delta updates and excludes
+//    readers and writers, so delta updates of a record run concurrently
+#ifndef DELTA
+#define DELTA 0
+#endif
+
+// 1: cycles per phase (lock, read, modify, write), 2: also perf counters
+//    per phase (see phase/phase.h)
+#ifndef PHASE_STATS
+#define PHASE_STATS 0
+#endif
+#include "../phase/phase.h"
+
+// delta operation: 0: add, 1: min, 2: max
+#ifndef DELTA_OP
+#define DELTA_OP 0
+#endif
+#if DELTA_OP == 1
+#define APPLY_DELTA(x,d) ((d) < (x) ? (d) : (x))
+#elif DELTA_OP == 2
+#define APPLY_DELTA(x,d) ((d) > (x) ? (d) : (x))
+#else
+#define APPLY_DELTA(x,d) ((x) + (d))
+#endif
+
+// 1: record the committed transactions to HISTORY_FILE for history/check
+//    (a version is a per-record write counter, advanced under the X lock)
+#ifndef HISTORY
+#define HISTORY 0
+#endif
+#if HISTORY
+#include "../history/history.h"
+#if DELTA
+#error "HISTORY orders writes by the X lock; delta updates share the I lock"
+#endif
+#endif
+
+#if DELTA
+typedef enum {LOCK_S=1, LOCK_X=2, LOCK_I=3} LOCK_MODE;
+
+// S is compatible with S, I (increment) with I, X with nothing
+typedef struct _MODE_LOCK {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    LOCK_MODE mode;  // mode of the holders
+    int n;           // # of holders
+} MODE_LOCK;
+#endif
+
 typedef struct _DATA {
     int val;
+#if DELTA
+    MODE_LOCK lock;
+#else
     pthread_rwlock_t lock;
+#endif
+#if HISTORY
+    int version;
+#endif
 } DATA;
 
-typedef enum {NONE=0, READ=1, WRITE=2} TYPE;
+typedef enum {NONE=0, READ=1, WRITE=2, DELTA_UPDATE=4} TYPE;
 
 typedef struct _XACT {
     int key;
     TYPE type;
 } XACT;
 
+typedef struct _THREAD_ARGS {
+    int   id;
+    XACT *xact;
+} THREAD_ARGS;
+
 DATA Database[NUM_DATA];
 pthread_t tid[NUM_THREADS];
 XACT xact[TX_LEN*N_REPEAT][NUM_THREADS];
+XACT *thread_xact[NUM_THREADS];
 
 
 
@@ -44,15 +113,61 @@ int get_time()
     return (t.tv_sec - start_time.tv_sec)*1000000 + t.tv_nsec/1000;
 }
 
+#if DELTA
+void mode_lock(MODE_LOCK *l, LOCK_MODE mode)
+{
+    pthread_mutex_lock(&l->mutex);
+    while (l->n > 0 && (mode == LOCK_X || l->mode != mode)) {
+        pthread_cond_wait(&l->cond, &l->mutex);
+    }
+    l->mode = mode;
+    l->n++;
+    pthread_mutex_unlock(&l->mutex);
+}
+
+void mode_unlock(MODE_LOCK *l)
+{
+    pthread_mutex_lock(&l->mutex);
+    if (--l->n == 0) {
+        pthread_cond_broadcast(&l->cond);
+    }
+    pthread_mutex_unlock(&l->mutex);
+}
+
+// other holders of the increment lock may apply their deltas concurrently
+void apply_delta(int *ptr, int d)
+{
+    int x = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(ptr, &x, APPLY_DELTA(x, d), 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+#endif
+
+#ifdef MP_PERCENT
+// a random key of partition p (keys p, p+NUM_THREADS, ...)
+int partition_key(int p)
+{
+    int n = (NUM_DATA - p + NUM_THREADS - 1) / NUM_THREADS;
+    return p + NUM_THREADS * (int)(random()/(1.0+RAND_MAX) * n);
+}
+#endif
 
 void *worker(void *arg)
 {
     TYPE types[NUM_DATA];
     int values[NUM_DATA];
-    XACT *xact = (XACT*)arg;
-    int t, tsum = 0;
+    XACT *xact = ((THREAD_ARGS*)arg)->xact;
+    int thread_id = ((THREAD_ARGS*)arg)->id;
+    uint64_t t, tsum = 0;
     int t_begin = get_time(), t_end;
     double t_elap, t_lock;
+    PHASES phases;
+    phase_init(&phases);
+#if HISTORY
+    HIST_BUF hist;
+    hist_init(&hist, thread_id);
+#endif
 
     for (int repeat=0; repeat < N_REPEAT; repeat++) {
 
@@ -62,86 +177,184 @@ void *worker(void *arg)
         }
 
         // Growing phase
+        PHASE(&phases, PH_READ);
         for (int i=0; i<TX_LEN; i++) {
             types[xact[i].key] |= xact[i].type;
         }
         for (int i=0; i<NUM_DATA; i++) {
+            if (types[i] != NONE) PHASE(&phases, PH_LOCK);
+#if DELTA
+            // read-modify-write keys become delta updates
+            if (types[i] == (READ|WRITE)) {
+                types[i] = WRITE|DELTA_UPDATE;
+                t = phase_now();
+                mode_lock(&Database[i].lock, LOCK_I);
+                tsum += phase_now() - t;
+            }
+            else if (types[i] & WRITE) {
+                t = phase_now();
+                mode_lock(&Database[i].lock, LOCK_X);
+                tsum += phase_now() - t;
+            }
+            else if (types[i] == READ) {
+                t = phase_now();
+                mode_lock(&Database[i].lock, LOCK_S);
+                tsum += phase_now() - t;
+            }
+#else
             if (types[i] & WRITE) {
-                t = get_time();
+                t = phase_now();
                 pthread_rwlock_wrlock(&Database[i].lock);
-                tsum += get_time() - t;
+                tsum += phase_now() - t;
             }
             else if (types[i] == READ) {
-                t = get_time();
+                t = phase_now();
                 pthread_rwlock_rdlock(&Database[i].lock);
-                tsum += get_time() - t;
+                tsum += phase_now() - t;
             }
+#endif
             if (types[i] & READ) {
+                PHASE(&phases, PH_READ);
                 values[i] = Database[i].val;
             }
         }
 
         // modify
+        PHASE(&phases, PH_MODIFY);
         for (int i=0; i<TX_LEN; i++) {
             if (xact[i].type == READ) {
                 values[xact[i].key] += 1;
             }
         }
 
+#if HISTORY
+        // all locks are held
+        hist_begin(&hist, 0);
+        for (int i=0; i<NUM_DATA; i++) {
+            if (types[i] & READ) hist_read(&hist, i, Database[i].version);
+            if (types[i] & WRITE) hist_write(&hist, i, ++Database[i].version);
+        }
+        hist_commit(&hist);
+#endif
+
         // Shrinking phase
+        PHASE(&phases, PH_WRITE);
         for (int i=0; i<NUM_DATA; i++) {
+#if DELTA
+            if (types[i] & DELTA_UPDATE) {
+                apply_delta(&Database[i].val, values[i]);
+            }
+            else if (types[i] & WRITE) {
+                Database[i].val = values[i];
+            }
+            if (types[i] & (READ|WRITE)) {
+                mode_unlock(&Database[i].lock);
+            }
+#else
             if (types[i] & WRITE) {
                 Database[i].val = values[i];
             }
             if (types[i] & (READ|WRITE)) {
                 pthread_rwlock_unlock(&Database[i].lock);
             }
+#endif
             //printf("values[%d]=%d Database[%d].val=%d\n",i,values[i],i,Database[i].val);
         }
 
         xact += TX_LEN;
     }
     t_end = get_time();
+#if HISTORY
+    hist_finish(&hist);
+#endif
     t_elap = (t_end-t_begin)*1e-6;
-    t_lock = tsum*1e-6;
+    t_lock = tsum/phase_tsc_hz();
     printf("time: elap=%f lock=%f lock_ratio=%f\n",t_elap,t_lock,t_lock/t_elap);
+    phase_report(&phases, thread_id, N_REPEAT);
 
     return NULL;
 }
 
 
-int main(){
+int main(int argc, char *argv[]){
     int i, j, sum;
+    THREAD_ARGS thread_args[NUM_THREADS];
 
     // Initialize Database
     for (i=0; i<NUM_DATA; i++) {
         Database[i].val = 0;
+#if DELTA
+        pthread_mutex_init(&Database[i].lock.mutex, 0);
+        pthread_cond_init(&Database[i].lock.cond, 0);
+        Database[i].lock.n = 0;
+#else
         pthread_rwlock_init(&Database[i].lock, 0 );
+#endif
+#if HISTORY
+        Database[i].version = 0;
+#endif
     }
     // Create Transaction
     sum = 0;
-    for(i=0; i<NUM_THREADS; i++){
-        //printf("thread%d:",i);
-        for(j=0; j<TX_LEN*N_REPEAT; j++){
-            xact[j][i].type = (random()&1) ? READ : WRITE;
-            xact[j][i].key = (int)(random()/(1.0+RAND_MAX) * NUM_DATA);
-            //printf(" %c%d",(xact[j][i].type==READ) ? 'r':'w', xact[j][i].key);
-            if (xact[j][i].type==READ) {
-                sum += 1;
+    if (argc > 1) {
+        // replay the trace argv[1] instead of generating the transactions
+        const TRACE_HEADER *h = trace_open(argv[1], NUM_THREADS, TX_LEN, N_REPEAT, NUM_DATA);
+        for (i=0; i<NUM_THREADS; i++) {
+            thread_xact[i] = TRACE_XACT(h, i);
+        }
+        sum = trace_n_read(h, NUM_THREADS, N_REPEAT);
+    } else {
+        for(i=0; i<NUM_THREADS; i++){
+            //printf("thread%d:",i);
+#ifdef MP_PERCENT
+            // thread i's transactions one after another in the same storage
+            XACT *x = (XACT*)xact + (long)i*TX_LEN*N_REPEAT;
+            for(j=0; j<TX_LEN*N_REPEAT; j+=TX_LEN){
+                int multi = (random()%100 < MP_PERCENT);
+                for (int k=j; k<j+TX_LEN; k++) {
+                    x[k].type = (random()&1) ? READ : WRITE;
+                    x[k].key = multi ? (int)(random()/(1.0+RAND_MAX) * NUM_DATA)
+                                     : partition_key(i);
+                    if (x[k].type==READ) {
+                        sum += 1;
+                    }
+                }
+            }
+            thread_xact[i] = x;
+#else
+            thread_xact[i] = xact[i];
+            for(j=0; j<TX_LEN*N_REPEAT; j++){
+                xact[j][i].type = (random()&1) ? READ : WRITE;
+                xact[j][i].key = (int)(random()/(1.0+RAND_MAX) * NUM_DATA);
+                //printf(" %c%d",(xact[j][i].type==READ) ? 'r':'w', xact[j][i].key);
+                if (xact[j][i].type==READ) {
+                    sum += 1;
+                }
             }
+#endif
+            //printf("\n");
         }
-        //printf("\n");
     }
     printf("# of READ=%d\n",sum);
+#if HISTORY
+    hist_open();
+#endif
     init_time();
     // Start threads
     for(i=0; i<NUM_THREADS; i++) {
-        pthread_create(&tid[i], NULL, worker, &xact[i]);
+        thread_args[i].id = i;
+        thread_args[i].xact = thread_xact[i];
+        pthread_create(&tid[i], NULL, worker, &thread_args[i]);
     }
     // Join threads
     for(i=0; i<NUM_THREADS; i++) {
         pthread_join(tid[i], NULL);
     }
+    phase_report_total((long)N_REPEAT*NUM_THREADS);
+#if HISTORY
+    hist_close();
+    printf("history: %s\n", HISTORY_FILE);
+#endif
     // Print result
     sum = 0;
     for (i=0; i<NUM_DATA; i++) {